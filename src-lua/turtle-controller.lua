@@ -50,8 +50,9 @@ function processEvents()
         elseif arg2["type"] == "status" then
             writeMessage(string.format("== Status for turtle %d ==", arg1))
             writeMessage(string.format(
-                "Instruction: %d | X: %d | Y: %d | Z: %d | Rotation: %d | Fuel: %d | Slot: %d | Paused: %s | On refill: %s",
+                "Instruction: %d (repeats done: %d) | X: %d | Y: %d | Z: %d | Rotation: %d | Fuel: %d | Slot: %d | Paused: %s | On refill: %s",
                 arg2["data"]["instr"],
+                arg2["data"]["repeatsDone"] or 0,
                 arg2["data"]["x"],
                 arg2["data"]["y"],
                 arg2["data"]["z"],
@@ -12,6 +12,8 @@ instructionIndex = 0
 materials = {}
 refillModemConnected = false
 currentRequest = nil
+currentRepeat = nil --repeat instruction in progress, its moves are performed one per action so that messages are handled between them
+resumeRepeat = nil --repeats already done of the instruction the driver was resumed at
 
 --global coordinates
 currentRotation = 1 --1 north, 2 east, 3 south, 4 west
@@ -52,6 +54,27 @@ function request(id, amount)
     return true
 end
 
+--all requests of a refill are sent as a single message, provider fulfills them in one pass
+function requestBatch(count)
+    local requests = {}
+    for i = 1, count do
+        local slot = readNext()
+        local id = readNext()
+        local amount = readNext()
+        table.insert(requests, {item = materials[id], amount = amount, slot = slot})
+    end
+
+    if not refillModemConnected and not findRefillModem() then
+        return false, "No wired modem found at refill."
+    end
+
+    paused = true
+    currentRequest = {type = "request_batch", requests = requests}
+    rednet.broadcast(currentRequest)
+    writeLog(string.format("Requesting %d stacks at once.", count))
+    return true
+end
+
 function unload(amount)
     if not refillModemConnected and not findRefillModem() then
         return false, "No wired modem found at refill."
@@ -150,13 +173,7 @@ end
 
 --main loop
 
-function nextAction()
-    action = readNext()
-    if not action then
-        writeLog("EOF in instruction file. Shutting down.")
-        os.shutdown()
-    end
-
+function performAction(action)
     if          action == 0     then    --NOP
     elseif      action == 1     then    checkAction(turtle.forward())    modifyPosition(0, 1, 0)
     elseif      action == 2     then    checkAction(turtle.back())       modifyPosition(0, -1, 0)
@@ -174,10 +191,52 @@ function nextAction()
     elseif      action == 14    then    checkAction(request(readNext(), readNext()))
     elseif      action == 15    then    checkAction(unload(readNext()))
     elseif      action == 16    then    checkAction(turtle.refuel(readNext()))
+    elseif      action == 17    then    repeatAction(readNext(), readNext())
+    elseif      action == 18    then    checkAction(requestBatch(readNext()))
     else writeLog("Unknown action")
     end
 end
 
+--only actions without any following bytes can be repeated
+function repeatAction(repeated, count)
+    if repeated > 12 then
+        writeLog(string.format("Action %d can't be repeated.", repeated))
+        return
+    end
+
+    --offset of the repeat instruction itself, status reports it while the repeat is in progress so that the driver can be resumed at it
+    local offset = instructionIndex - 3
+    local done = 0
+    if resumeRepeat and resumeRepeat.offset == offset then
+        done = math.min(resumeRepeat.done, count)
+    end
+
+    resumeRepeat = nil
+    if done < count then
+        currentRepeat = {action = repeated, offset = offset, count = count, done = done}
+    end
+end
+
+function nextAction()
+    if currentRepeat then
+        action = currentRepeat.action
+        performAction(action)
+        currentRepeat.done = currentRepeat.done + 1
+        if currentRepeat.done == currentRepeat.count then
+            currentRepeat = nil
+        end
+        return
+    end
+
+    action = readNext()
+    if not action then
+        writeLog("EOF in instruction file. Shutting down.")
+        os.shutdown()
+    end
+
+    performAction(action)
+end
+
 function processMessage(id, msg)
     if msg["type"] == "status" then
         writeLog("Sending status.")
@@ -186,7 +245,8 @@ function processMessage(id, msg)
                 type = "status",
                 data =
                 {
-                    instr = instructionIndex,
+                    instr = currentRepeat and currentRepeat.offset or instructionIndex,
+                    repeatsDone = currentRepeat and currentRepeat.done or 0,
                     x = currentX,
                     y = currentY,
                     z = currentZ,
@@ -207,6 +267,7 @@ function processMessage(id, msg)
         writeLog(string.format("Jumping to instruction no. %d.", msg["instr"]))
         instructionIndex = msg["instr"]
         instructionHandle.seek("set", instructionIndex)
+        currentRepeat = nil
     elseif msg["type"] == "request_done" then
         writeLog("Request done, continuing.")
         paused = false
@@ -262,6 +323,13 @@ instrOffsetStr = read()
 if instrOffsetStr ~= "" then
     instructionIndex = tonumber(instrOffsetStr)
     instructionHandle.seek("set", tonumber(instrOffsetStr))
+
+    --status reports the offset of a repeat instruction in progress along with the amount of repeats which were already done
+    print("Repeats already done (if the offset is of a repeat instruction, empty for none): ")
+    local repeatsStr = read()
+    if repeatsStr ~= "" then
+        resumeRepeat = {offset = instructionIndex, done = tonumber(repeatsStr)}
+    end
 end
 
 print("Controller ID: ")
@@ -92,6 +92,29 @@ function processRequest(tname, request)
     return true
 end
 
+--whole batch is fulfilled only if there's enough of every requested item, so a retried batch doesn't push anything twice
+function processBatch(tname, batch)
+    local requested = {}
+    for _, request in pairs(batch["requests"]) do
+        local itemName = request["item"]
+        requested[itemName] = (requested[itemName] or 0) + request["amount"]
+    end
+
+    for itemName, amount in pairs(requested) do
+        local available = itemCount[itemName] or 0
+        if available < amount then
+            if not batch["stale"] then writeLog(string.format("Insufficient amount of '%s', %d available but %d was requested.", itemName, available, amount)) end
+            return false
+        end
+    end
+
+    for _, request in pairs(batch["requests"]) do
+        processRequest(tname, request)
+    end
+
+    return true
+end
+
 function processUnload(tname, request)
     local itemName = request["item"]
     local amount = request["amount"]
@@ -149,6 +172,16 @@ function processEvents()
             else
                 rednet.send(arg1, { type = "request_done" })
             end
+        elseif arg2["type"] == "request_batch" then
+            if not processBatch(wrappedTurtle, arg2) then
+                if not arg2["stale"] then
+                    arg2["stale"] = true
+                    writeLog("Cannot process request batch, marking as stale.")
+                end
+                os.queueEvent("rednet_message", arg1, arg2)
+            else
+                rednet.send(arg1, { type = "request_done" })
+            end
         elseif arg2["type"] == "unload" then
             if not processUnload(wrappedTurtle, arg2) then
                 if not arg2["stale"] then
@@ -0,0 +1,589 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "dither.hpp"
+#include "parallel.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DITHER_X86
+#include <immintrin.h>
+#endif
+
+//https://en.wikipedia.org/wiki/Relative_luminance
+const float RedWeight = 0.2126f / 255.0f;
+const float GreenWeight = 0.7152f / 255.0f;
+const float BlueWeight = 0.0722f / 255.0f;
+const float Transparent = -1.0f; //luminance of transparent pixels
+
+//luminance (0 - 1 times 'multiplier') of 'count' r8g8b8a8 pixels
+static void GetLuminance(const unsigned char* pixels, float* luminance, unsigned int count, float multiplier)
+{
+    unsigned int i = 0;
+
+#ifdef DITHER_X86
+    //4 pixels per iteration, SSE2 is always available on x86-64
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 red = _mm_set1_ps(RedWeight * multiplier);
+    const __m128 green = _mm_set1_ps(GreenWeight * multiplier);
+    const __m128 blue = _mm_set1_ps(BlueWeight * multiplier);
+    const __m128 transparent = _mm_set1_ps(Transparent);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+        __m128 r = _mm_cvtepi32_ps(_mm_and_si128(rgba, byteMask));
+        __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgba, 8), byteMask));
+        __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgba, 16), byteMask));
+        __m128 lum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, red), _mm_mul_ps(g, green)), _mm_mul_ps(b, blue));
+
+        __m128 empty = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_srli_epi32(rgba, 24), zero));
+        _mm_storeu_ps(luminance + i, _mm_or_ps(_mm_and_ps(empty, transparent), _mm_andnot_ps(empty, lum)));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        const unsigned char* p = pixels + i * 4;
+        float lum = (p[0] * RedWeight + p[1] * GreenWeight + p[2] * BlueWeight) * multiplier;
+        luminance[i] = p[3] == 0 ? Transparent : lum;
+    }
+}
+
+const unsigned int WavefrontChunk = 64; //pixels a row goes ahead before it tells the next row and checks the previous one again
+
+//error diffusion of several rows at once, each row stays a few pixels behind the one above (https://en.wikipedia.org/wiki/Wavefront_parallelism)
+//pixel x of a row needs the errors of pixels up to x + 1 of the previous row, errors are added in the same order as when rows are done one by one
+struct Wavefront
+{
+    unsigned int Width;
+    std::vector<std::atomic<unsigned int>> Progress; //pixels done of each row
+
+    Wavefront(unsigned int width, unsigned int height) : Width(width), Progress(height)
+    {
+    }
+
+    //waits until the row above has passed everything the pixels up to 'x' need
+    void WaitFor(unsigned int y, unsigned int x)
+    {
+        if (y == 0)
+            return;
+
+        unsigned int needed = std::min(x + 2, Width);
+        while (Progress[y - 1].load(std::memory_order_acquire) < needed)
+            std::this_thread::yield();
+    }
+
+    void Publish(unsigned int y, unsigned int done)
+    {
+        Progress[y].store(done, std::memory_order_release);
+    }
+};
+
+//calls 'fn(y, thread, error, below, wavefront)' for each row, 'error' holds the errors diffused from the row above (with a padding pixel on both sides),
+//'below' (cleared, starting at the left padding pixel) takes the errors for the next row, rows are spread over 'threadCount' threads (every n-th row)
+//row y clears the buffer written by row y - threadCount - 2 and read by row y - threadCount - 1, neither of them is done by this thread, but
+//row y - threadCount is, and its last wavefront wait returns only once row y - threadCount - 1 has published its whole width (so it's done with it)
+template<typename T, typename Fn>
+static void DiffuseRows(unsigned int width, unsigned int height, unsigned int threadCount, Fn fn)
+{
+    threadCount = std::max(1u, std::min(threadCount, height));
+    unsigned int ringSize = threadCount + 2;
+    std::vector<std::vector<T>> errors = std::vector<std::vector<T>>(ringSize, std::vector<T>(width + 2));
+    Wavefront wavefront = Wavefront(width, height);
+    ParallelFor(0, threadCount, threadCount, [&](unsigned int first, unsigned int t)
+    {
+        for (unsigned int y = first; y < height; y += threadCount)
+        {
+            std::vector<T>& below = errors[(y + 1) % ringSize];
+            std::fill(below.begin(), below.end(), T {});
+            fn(y, t, errors[y % ringSize].data() + 1, below.data(), wavefront);
+            wavefront.Publish(y, width);
+        }
+    });
+}
+
+unsigned char* FloydSteinberg(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int colors,
+    float luminanceMultiplier,
+    float errorMultiplier,
+    bool alphaToBlack,
+    unsigned int threads)
+{
+    if (colors < 2 || colors > 0xFF)
+        throw std::runtime_error("Amount of colors should be in 2 - 255 range.");
+
+    threads = std::max(1u, threads);
+    unsigned char* convertedData = new unsigned char[static_cast<size_t>(width) * height];
+    float levels = colors - 1.0f;
+    float levelStep = 1.0f / levels;
+    unsigned char shades[0x100]; //gray shade of each color
+    for (unsigned int c = 0; c < colors; c++)
+        shades[c] = static_cast<unsigned char>(c * 255.0f / levels + 0.5f);
+
+    std::vector<std::vector<float>> luminances = std::vector<std::vector<float>>(threads, std::vector<float>(width));
+    DiffuseRows<float>(width, height, threads, [&](unsigned int y, unsigned int t, const float* error, float* below, Wavefront& wavefront)
+    {
+        unsigned char* pixels = data + static_cast<size_t>(y) * width * 4;
+        unsigned char* converted = convertedData + static_cast<size_t>(y) * width;
+        float* luminance = luminances[t].data();
+        GetLuminance(pixels, luminance, width, luminanceMultiplier);
+
+        //error diffused from the left is added last, so it doesn't have to wait in the buffer for the row above to pass
+        //'below[x + 1]' is right under the pixel (unsigned 'x - 1' would wrap around)
+        float left = 0.0f;
+        for (unsigned int x = 0; x < width; x++)
+        {
+            if (x % WavefrontChunk == 0)
+            {
+                wavefront.Publish(y, x);
+                wavefront.WaitFor(y, x + WavefrontChunk - 1);
+            }
+
+            unsigned char* p = pixels + x * 4;
+            if (luminance[x] == Transparent)
+            {
+                if (alphaToBlack)
+                {
+                    converted[x] = 1;
+                    p[0] = p[1] = p[2] = 0;
+                    p[3] = 0xFF;
+                }
+                else
+                {
+                    converted[x] = 0;
+                }
+
+                left = 0.0f;
+                continue;
+            }
+
+            //nearest color, the rest is passed to the neighbours
+            float value = std::clamp(luminance[x] + (error[x] + left), 0.0f, 1.0f); //error of colors outside of the range would only grow
+            int color = static_cast<int>(value * levels + 0.5f);
+            float quantizationError = (value - color * levelStep) * errorMultiplier;
+            left = quantizationError * (7.0f / 16.0f);
+            below[x] += quantizationError * (3.0f / 16.0f);
+            below[x + 1] += quantizationError * (5.0f / 16.0f);
+            below[x + 2] += quantizationError * (1.0f / 16.0f);
+
+            p[0] = p[1] = p[2] = shades[color];
+            p[3] = 0xFF;
+            converted[x] = color + 1;
+        }
+    });
+
+    return convertedData;
+}
+
+static void Diffuse(Lab& target, const Lab& error, float weight)
+{
+    target.L += error.L * weight;
+    target.A += error.A * weight;
+    target.B += error.B * weight;
+}
+
+unsigned char* PaletteDither(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    const std::vector<PaletteColor>& palette,
+    float luminanceMultiplier,
+    float errorMultiplier,
+    bool alphaToBlack,
+    unsigned int threads)
+{
+    if (palette.empty() || palette.size() > MaxPaletteSize)
+        throw std::runtime_error(std::format("Palette should contain 1 - {} colors.", MaxPaletteSize));
+
+    threads = std::max(1u, threads);
+    PaletteLookup lookup = PaletteLookup(palette);
+    unsigned char* convertedData = new unsigned char[static_cast<size_t>(width) * height];
+    unsigned int black = lookup.Nearest(Lab { 0.0f, 0.0f, 0.0f });
+
+    std::vector<std::vector<Lab>> colors = std::vector<std::vector<Lab>>(threads, std::vector<Lab>(width));
+    DiffuseRows<Lab>(width, height, threads, [&](unsigned int y, unsigned int t, const Lab* error, Lab* below, Wavefront& wavefront)
+    {
+        unsigned char* pixels = data + static_cast<size_t>(y) * width * 4;
+        unsigned char* converted = convertedData + static_cast<size_t>(y) * width;
+        Lab* row = colors[t].data();
+        for (unsigned int x = 0; x < width; x++)
+            row[x] = ToLab(pixels + x * 4, luminanceMultiplier); //converted ahead, the diffusion loop waits for the previous pixel anyway
+
+        //same order of additions as in 'FloydSteinberg'
+        Lab left = { 0.0f, 0.0f, 0.0f };
+        for (unsigned int x = 0; x < width; x++)
+        {
+            if (x % WavefrontChunk == 0)
+            {
+                wavefront.Publish(y, x);
+                wavefront.WaitFor(y, x + WavefrontChunk - 1);
+            }
+
+            unsigned char* p = pixels + x * 4;
+            unsigned int color;
+            if (p[3] == 0)
+            {
+                left = { 0.0f, 0.0f, 0.0f };
+                if (!alphaToBlack)
+                {
+                    converted[x] = 0;
+                    continue;
+                }
+
+                color = black;
+            }
+            else
+            {
+                const Lab& pixel = row[x];
+                Lab value = PaletteLookup::Clamp(Lab { pixel.L + (error[x].L + left.L), pixel.A + (error[x].A + left.A), pixel.B + (error[x].B + left.B) });
+                color = lookup.Nearest(value);
+
+                const Lab& chosen = palette[color].Color;
+                Lab quantizationError = { (value.L - chosen.L) * errorMultiplier, (value.A - chosen.A) * errorMultiplier, (value.B - chosen.B) * errorMultiplier };
+                left = { 0.0f, 0.0f, 0.0f };
+                Diffuse(left, quantizationError, 7.0f / 16.0f);
+                Diffuse(below[x], quantizationError, 3.0f / 16.0f);
+                Diffuse(below[x + 1], quantizationError, 5.0f / 16.0f);
+                Diffuse(below[x + 2], quantizationError, 1.0f / 16.0f);
+            }
+
+            std::copy_n(palette[color].Rgb, 3, p);
+            p[3] = 0xFF;
+            converted[x] = color + 1;
+        }
+    });
+
+    return convertedData;
+}
+
+//thresholds (0 - 1) of a square map which is tiled over the image, size is a power of two
+struct Thresholds
+{
+    unsigned int Size;
+    std::vector<float> Values;
+
+    //map's row for the image row 'y'
+    const float* GetRow(unsigned int y) const
+    {
+        return Values.data() + (y & (Size - 1)) * Size;
+    }
+};
+
+const unsigned int BayerSize = 16;
+const unsigned int BlueNoiseSize = 64;
+const unsigned int NoPixel = 0xFFFFFFFF;
+const float BlueNoiseSigma = 1.5f; //spread of the energy function, suggested by the paper
+const unsigned int RowsPerTask = 16; //rows dithered by a thread at once
+
+//turns ranks (order in which the pixels turn on) into thresholds in the middle of each step
+static Thresholds RanksToThresholds(unsigned int size, const std::vector<unsigned int>& ranks)
+{
+    Thresholds thresholds;
+    thresholds.Size = size;
+    thresholds.Values.resize(ranks.size());
+    for (size_t i = 0; i < ranks.size(); i++)
+        thresholds.Values[i] = (ranks[i] + 0.5f) / ranks.size();
+    return thresholds;
+}
+
+//each doubling puts the 4 copies of the smaller map in the 0, 2, 3, 1 order
+static Thresholds GetBayerMap()
+{
+    std::vector<unsigned int> ranks = { 0 };
+    for (unsigned int size = 1; size < BayerSize; size *= 2)
+    {
+        const unsigned int quadrants[4] = { 0, 2, 3, 1 };
+        std::vector<unsigned int> larger = std::vector<unsigned int>(size * size * 4);
+        for (unsigned int y = 0; y < size * 2; y++)
+        {
+            for (unsigned int x = 0; x < size * 2; x++)
+                larger[y * size * 2 + x] = ranks[(y % size) * size + x % size] * 4 + quadrants[(y / size) * 2 + x / size];
+        }
+
+        ranks = std::move(larger);
+    }
+
+    return RanksToThresholds(BayerSize, ranks);
+}
+
+//Ulichney's void-and-cluster method (https://cv.ulichney.com/papers/1993-void-cluster.pdf)
+//pixels are turned on one by one where they're the furthest from the others (largest void), their order becomes the threshold
+//pattern wraps around so that the map can be tiled, it's generated once (with a fixed seed) when first used
+static Thresholds GetBlueNoiseMap()
+{
+    const unsigned int size = BlueNoiseSize;
+    const unsigned int count = size * size;
+
+    //energy added to each pixel by a pixel which is on, indexed by the (wrapped) offset between them
+    std::vector<float> kernel = std::vector<float>(count);
+    for (unsigned int dy = 0; dy < size; dy++)
+    {
+        for (unsigned int dx = 0; dx < size; dx++)
+        {
+            float x = static_cast<float>(std::min(dx, size - dx));
+            float y = static_cast<float>(std::min(dy, size - dy));
+            kernel[dy * size + dx] = std::exp(-(x * x + y * y) / (2.0f * BlueNoiseSigma * BlueNoiseSigma));
+        }
+    }
+
+    std::vector<bool> on = std::vector<bool>(count);
+    std::vector<float> energy = std::vector<float>(count);
+    auto toggle = [&](std::vector<bool>& pattern, std::vector<float>& energies, unsigned int i)
+    {
+        pattern[i] = !pattern[i];
+        float sign = pattern[i] ? 1.0f : -1.0f;
+        unsigned int x = i % size, y = i / size;
+        for (unsigned int j = 0; j < count; j++)
+            energies[j] += sign * kernel[((j / size - y) & (size - 1)) * size + ((j % size - x) & (size - 1))];
+    };
+    //tightest cluster is the pixel which is on and has the most energy, largest void is the pixel which is off and has the least
+    auto find = [&](const std::vector<bool>& pattern, const std::vector<float>& energies, bool cluster)
+    {
+        unsigned int best = NoPixel;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (pattern[i] == cluster && (best == NoPixel || (cluster ? energies[i] > energies[best] : energies[i] < energies[best])))
+                best = i;
+        }
+
+        return best;
+    };
+
+    //random initial pattern (a tenth of the pixels) is evened out by moving the tightest cluster to the largest void until it's the same pixel
+    std::mt19937 random = std::mt19937(1);
+    unsigned int initial = count / 10;
+    for (unsigned int placed = 0; placed < initial;)
+    {
+        unsigned int i = random() % count;
+        if (!on[i])
+        {
+            toggle(on, energy, i);
+            placed++;
+        }
+    }
+
+    while (true)
+    {
+        unsigned int cluster = find(on, energy, true);
+        toggle(on, energy, cluster);
+        unsigned int largestVoid = find(on, energy, false);
+        toggle(on, energy, largestVoid);
+        if (largestVoid == cluster)
+            break;
+    }
+
+    //initial pixels are ranked by removing the tightest clusters, the rest by filling the largest voids
+    std::vector<unsigned int> ranks = std::vector<unsigned int>(count);
+    std::vector<bool> removed = on;
+    std::vector<float> removedEnergy = energy;
+    for (unsigned int rank = initial; rank-- > 0;)
+    {
+        unsigned int cluster = find(removed, removedEnergy, true);
+        toggle(removed, removedEnergy, cluster);
+        ranks[cluster] = rank;
+    }
+
+    for (unsigned int rank = initial; rank < count; rank++)
+    {
+        unsigned int largestVoid = find(on, energy, false);
+        toggle(on, energy, largestVoid);
+        ranks[largestVoid] = rank;
+    }
+
+    return RanksToThresholds(size, ranks);
+}
+
+static const Thresholds& GetThresholds(ThresholdMap map)
+{
+    if (map == ThresholdMap::Bayer)
+    {
+        static const Thresholds bayer = GetBayerMap();
+        return bayer;
+    }
+
+    static const Thresholds blueNoise = GetBlueNoiseMap();
+    return blueNoise;
+}
+
+//calls 'fn(y, thread)' for each row, threads take a few rows at a time
+template<typename Fn>
+static void ForEachRow(unsigned int height, unsigned int threadCount, Fn fn)
+{
+    ParallelFor(0, (height + RowsPerTask - 1) / RowsPerTask, threadCount, [&](unsigned int task, unsigned int t)
+    {
+        for (unsigned int y = task * RowsPerTask; y < std::min(height, (task + 1) * RowsPerTask); y++)
+            fn(y, t);
+    });
+}
+
+unsigned char* OrderedDither(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int colors,
+    float luminanceMultiplier,
+    bool alphaToBlack,
+    ThresholdMap map,
+    unsigned int threads)
+{
+    if (colors < 2 || colors > 0xFF)
+        throw std::runtime_error("Amount of colors should be in 2 - 255 range.");
+
+    const Thresholds& thresholds = GetThresholds(map);
+    unsigned char* convertedData = new unsigned char[static_cast<size_t>(width) * height];
+    float levels = colors - 1.0f;
+    unsigned char shades[0x100];
+    for (unsigned int c = 0; c < colors; c++)
+        shades[c] = static_cast<unsigned char>(c * 255.0f / levels + 0.5f);
+    unsigned char transparentColor = alphaToBlack ? 1 : 0;
+
+    threads = std::max(1u, threads);
+    std::vector<std::vector<float>> luminances = std::vector<std::vector<float>>(threads, std::vector<float>(width));
+    ForEachRow(height, threads, [&](unsigned int y, unsigned int t)
+    {
+        unsigned char* pixels = data + static_cast<size_t>(y) * width * 4;
+        unsigned char* converted = convertedData + static_cast<size_t>(y) * width;
+        const float* row = thresholds.GetRow(y);
+        const unsigned int mask = thresholds.Size - 1;
+        float* luminance = luminances[t].data();
+        GetLuminance(pixels, luminance, width, luminanceMultiplier);
+
+        //color is the luminance scaled to the levels plus the threshold, rounded down
+        unsigned int x = 0;
+#ifdef DITHER_X86
+        //map's size is a multiple of 4, so the 4 thresholds are always next to each other
+        const __m128 top = _mm_set1_ps(levels);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 transparent = _mm_set1_ps(Transparent);
+        const __m128i one = _mm_set1_epi32(1);
+        const __m128i transparentColors = _mm_set1_epi32(transparentColor);
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128 lum = _mm_loadu_ps(luminance + x);
+            __m128 value = _mm_add_ps(_mm_mul_ps(lum, top), _mm_loadu_ps(row + (x & mask)));
+            __m128i color = _mm_add_epi32(_mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(value, zero), top)), one);
+
+            __m128i empty = _mm_castps_si128(_mm_cmpeq_ps(lum, transparent));
+            color = _mm_or_si128(_mm_and_si128(empty, transparentColors), _mm_andnot_si128(empty, color));
+            __m128i words = _mm_packs_epi32(color, color);
+            __m128i packed = _mm_packus_epi16(words, words);
+            int bytes = _mm_cvtsi128_si32(packed);
+            std::memcpy(converted + x, &bytes, 4);
+        }
+#endif
+
+        for (; x < width; x++)
+        {
+            float value = std::clamp(luminance[x] * levels + row[x & mask], 0.0f, levels);
+            converted[x] = luminance[x] == Transparent ? transparentColor : static_cast<unsigned char>(value) + 1;
+        }
+
+        for (x = 0; x < width; x++)
+        {
+            unsigned char* p = pixels + x * 4;
+            if (converted[x] == 0)
+                continue;
+
+            p[0] = p[1] = p[2] = shades[converted[x] - 1];
+            p[3] = 0xFF;
+        }
+    });
+
+    return convertedData;
+}
+
+//average distance between a palette color and the closest other one
+static float GetPaletteSpacing(const std::vector<PaletteColor>& palette)
+{
+    if (palette.size() < 2)
+        return 0.0f;
+
+    float total = 0.0f;
+    for (const PaletteColor& color : palette)
+    {
+        float closest = INFINITY;
+        for (const PaletteColor& other : palette)
+        {
+            if (&other == &color)
+                continue;
+
+            float l = color.Color.L - other.Color.L, a = color.Color.A - other.Color.A, b = color.Color.B - other.Color.B;
+            closest = std::min(closest, std::sqrt(l * l + a * a + b * b));
+        }
+
+        total += closest;
+    }
+
+    return total / palette.size();
+}
+
+unsigned char* OrderedPaletteDither(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    const std::vector<PaletteColor>& palette,
+    float luminanceMultiplier,
+    bool alphaToBlack,
+    ThresholdMap map,
+    unsigned int threads)
+{
+    if (palette.empty() || palette.size() > MaxPaletteSize)
+        throw std::runtime_error(std::format("Palette should contain 1 - {} colors.", MaxPaletteSize));
+
+    const Thresholds& thresholds = GetThresholds(map);
+    PaletteLookup lookup = PaletteLookup(palette);
+    unsigned char* convertedData = new unsigned char[static_cast<size_t>(width) * height];
+    unsigned int black = lookup.Nearest(Lab { 0.0f, 0.0f, 0.0f });
+    float spacing = GetPaletteSpacing(palette);
+
+    threads = std::max(1u, threads);
+    ForEachRow(height, threads, [&](unsigned int y, unsigned int)
+    {
+        unsigned char* pixels = data + static_cast<size_t>(y) * width * 4;
+        unsigned char* converted = convertedData + static_cast<size_t>(y) * width;
+        const unsigned int mask = thresholds.Size - 1;
+        const unsigned int half = thresholds.Size / 2;
+        //channels use thresholds from different quarters of the map, otherwise colors would only move along the gray diagonal
+        const float* rowL = thresholds.GetRow(y);
+        const float* rowA = thresholds.GetRow(y + half);
+        const float* rowB = thresholds.GetRow(y);
+        for (unsigned int x = 0; x < width; x++)
+        {
+            unsigned char* p = pixels + x * 4;
+            unsigned int color;
+            if (p[3] == 0)
+            {
+                if (!alphaToBlack)
+                {
+                    converted[x] = 0;
+                    continue;
+                }
+
+                color = black;
+            }
+            else
+            {
+                Lab pixel = ToLab(p, luminanceMultiplier);
+                pixel.L += (rowL[x & mask] - 0.5f) * spacing;
+                pixel.A += (rowA[(x + half) & mask] - 0.5f) * spacing;
+                pixel.B += (rowB[(x + half) & mask] - 0.5f) * spacing;
+                color = lookup.Nearest(PaletteLookup::Clamp(pixel));
+            }
+
+            std::copy_n(palette[color].Rgb, 3, p);
+            p[3] = 0xFF;
+            converted[x] = color + 1;
+        }
+    });
+
+    return convertedData;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include "palette.hpp"
+
+/*
+https://en.wikipedia.org/wiki/Floyd%E2%80%93Steinberg_dithering
+converts a r8g8b8a8 image (from 'data') to a grayscale image with the 'colors' colors using dithering (written back to 'data')
+'errorMultiplier' scales the diffused quantization error, 1 diffuses all of it and 0 just rounds each pixel to the nearest color
+if 'alphaToBlack' is set all of the transparent pixels will become black
+rows are dithered on 'threads' threads in a staggered wavefront, the result is exactly the same for any amount of threads
+returns an array of bytes, each equal to pixel's color index, 0 for transparent pixels and higher values for lighter tones (e.g. with two colors white will be 2 and black will be 1)
+*/
+unsigned char* FloydSteinberg(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int colors,
+    float luminanceMultiplier,
+    float errorMultiplier,
+    bool alphaToBlack,
+    unsigned int threads);
+
+/*
+same as 'FloydSteinberg' but with colors from the 'palette', pixels are matched and the error is diffused in the Oklab color space
+'luminanceMultiplier' scales the linear RGB values of the image, preview written back to 'data' uses palette's colors
+returns palette index + 1 of each pixel (so the indices are the same as the materials' order in the palette) or 0 for transparent pixels,
+transparent pixels become the color closest to black if 'alphaToBlack' is set
+*/
+unsigned char* PaletteDither(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    const std::vector<PaletteColor>& palette,
+    float luminanceMultiplier,
+    float errorMultiplier,
+    bool alphaToBlack,
+    unsigned int threads);
+
+enum class ThresholdMap : unsigned char
+{
+    Bayer, //https://en.wikipedia.org/wiki/Ordered_dithering, regular cross-hatch pattern
+    BlueNoise //void-and-cluster, patterns without visible structure
+};
+
+/*
+ordered dithering, each pixel is compared with a tiled threshold map and doesn't depend on any other pixel,
+so the rows are dithered on 'threads' threads in any order, the result is a bit noisier than with 'FloydSteinberg'
+arguments and the returned array are the same as in 'FloydSteinberg'
+*/
+unsigned char* OrderedDither(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    unsigned int colors,
+    float luminanceMultiplier,
+    bool alphaToBlack,
+    ThresholdMap map,
+    unsigned int threads);
+
+//ordered dithering with colors from the 'palette', each Oklab channel is offset by a threshold (from different parts of the map) scaled by the spacing of the palette's colors
+//arguments and the returned array are the same as in 'PaletteDither'
+unsigned char* OrderedPaletteDither(
+    unsigned char* data,
+    unsigned int width,
+    unsigned int height,
+    const std::vector<PaletteColor>& palette,
+    float luminanceMultiplier,
+    bool alphaToBlack,
+    ThresholdMap map,
+    unsigned int threads);
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "hollow.hpp"
+#include "parallel.hpp"
+
+//distance of each voxel to the nearest empty voxel of the same layer (empty ones have zero), capped at 'cap'
+//rows and then columns are scanned both ways, which gives the exact 4-connected distance
+static void GetLayerDistances(const unsigned char* layer, unsigned char* dist, unsigned int width, unsigned int length, unsigned char cap)
+{
+	for (unsigned int y = 0; y < length; y++)
+	{
+		const unsigned char* row = layer + static_cast<size_t>(y) * width;
+		unsigned char* d = dist + static_cast<size_t>(y) * width;
+		unsigned char prev = 0; //outside of the model
+		for (unsigned int x = 0; x < width; x++)
+		{
+			prev = row[x] ? std::min<unsigned char>(prev + 1, cap) : 0;
+			d[x] = prev;
+		}
+
+		prev = 0;
+		for (unsigned int x = width; x-- > 0;)
+		{
+			prev = std::min<unsigned char>(prev + 1, d[x]);
+			d[x] = prev;
+		}
+	}
+
+	//columns are processed a whole row at a time so that the inner loops run over contiguous memory
+	for (unsigned int x = 0; x < width; x++)
+		dist[x] = std::min<unsigned char>(dist[x], 1);
+	for (unsigned int y = 1; y < length; y++)
+	{
+		unsigned char* d = dist + static_cast<size_t>(y) * width;
+		const unsigned char* up = d - width;
+		for (unsigned int x = 0; x < width; x++)
+			d[x] = std::min<unsigned char>(d[x], up[x] + 1);
+	}
+
+	unsigned char* last = dist + static_cast<size_t>(length - 1) * width;
+	for (unsigned int x = 0; x < width; x++)
+		last[x] = std::min<unsigned char>(last[x], 1);
+	for (unsigned int y = length - 1; y-- > 0;)
+	{
+		unsigned char* d = dist + static_cast<size_t>(y) * width;
+		const unsigned char* down = d + width;
+		for (unsigned int x = 0; x < width; x++)
+			d[x] = std::min<unsigned char>(d[x], down[x] + 1);
+	}
+}
+
+unsigned long long HollowModel(VoxelModel& model, unsigned int thickness)
+{
+	if (model.Storage == VoxelStorage::Compressed)
+		throw std::runtime_error("Compressed models are read only, load the model into bricks to hollow it.");
+	if (thickness > MaxShellThickness)
+		throw std::runtime_error(std::format("Shell can be at most {} voxels thick.", MaxShellThickness));
+	if (thickness == 0 || model.GetSize() == 0)
+		return 0;
+
+	//distance to the nearest empty voxel in 3D is the lowest of the in-layer distances of the layers above and below plus the vertical distance,
+	//so layer distances are kept in a ring large enough for one batch of layers (one per thread) and the layers around it
+	unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+	unsigned int ringSize = threadCount + 2 * thickness;
+	size_t layerSize = model.GetLayerSize();
+	unsigned char cap = thickness + 1; //voxels further away than the thickness are removed, it doesn't matter how far
+	std::vector<std::vector<unsigned char>> distances(ringSize);
+	std::vector<std::vector<unsigned char>> buffers(threadCount);
+	std::vector<std::vector<unsigned char>> hollowed(threadCount);
+	std::vector<unsigned long long> removed(threadCount);
+
+	unsigned long long totalRemoved = 0;
+	unsigned int computed = 0; //layers below this one have their distances in the ring
+	for (unsigned int begin = 0; begin < model.Height; begin += threadCount)
+	{
+		unsigned int end = std::min(model.Height, begin + threadCount);
+		unsigned int needed = std::min(model.Height, end + thickness);
+		ParallelFor(computed, needed, threadCount, [&](unsigned int z, unsigned int t)
+		{
+			buffers[t].resize(layerSize);
+			distances[z % ringSize].resize(layerSize);
+			model.CopyLayer(z, buffers[t].data());
+			GetLayerDistances(buffers[t].data(), distances[z % ringSize].data(), model.Width, model.Length, cap);
+		});
+		computed = needed;
+
+		//layers are only read here, changed ones are written back once all threads finish (bricked models can't be written to in parallel)
+		ParallelFor(begin, end, threadCount, [&](unsigned int z, unsigned int t)
+		{
+			removed[z - begin] = 0;
+			if (z < thickness || z + thickness >= model.Height)
+				return; //space below or above the model is close enough to every voxel of the layer
+
+			buffers[t].resize(layerSize);
+			unsigned char* nearest = buffers[t].data();
+			std::copy_n(distances[z % ringSize].data(), layerSize, nearest);
+			for (unsigned int k = 1; k <= thickness; k++)
+			{
+				const unsigned char* below = distances[(z - k) % ringSize].data();
+				const unsigned char* above = distances[(z + k) % ringSize].data();
+				unsigned char vertical = k;
+				for (size_t i = 0; i < layerSize; i++)
+					nearest[i] = std::min<unsigned char>(nearest[i], std::min(below[i], above[i]) + vertical);
+			}
+
+			std::vector<unsigned char>& voxels = hollowed[z - begin];
+			voxels.resize(layerSize);
+			model.CopyLayer(z, voxels.data());
+			unsigned long long count = 0;
+			for (size_t i = 0; i < layerSize; i++)
+			{
+				bool interior = nearest[i] > thickness;
+				voxels[i] = interior ? 0 : voxels[i];
+				count += interior;
+			}
+			removed[z - begin] = count;
+		});
+
+		for (unsigned int z = begin; z < end; z++)
+		{
+			if (!removed[z - begin])
+				continue;
+
+			model.SetLayer(z, hollowed[z - begin].data());
+			totalRemoved += removed[z - begin];
+		}
+	}
+
+	return totalRemoved;
+}
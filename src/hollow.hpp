@@ -0,0 +1,10 @@
+#pragma once
+#include "voxel.hpp"
+
+const unsigned int MaxShellThickness = 100;
+
+//removes voxels which are more than 'thickness' voxels away from the nearest empty voxel (6-connected, space outside of the model is empty)
+//so that only a shell of the given thickness is built, enclosed cavities get their own shell
+//layers are processed in parallel, only 2 * thickness + 1 layers of distances and a few layers per thread are kept in memory
+//compressed models are read only, returns the number of removed voxels
+unsigned long long HollowModel(VoxelModel& model, unsigned int thickness);
@@ -2,104 +2,284 @@
 #include <ios>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <filesystem>
+#include <format>
+#include <cctype>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <cstdint>
 #include "stb_image.h"
 #include "stb_image_write.h"
 #include "voxel.hpp"
+#include "dither.hpp"
+#include "parallel.hpp"
 
-std::tuple<unsigned char&, unsigned char&, unsigned char&, unsigned char&> GetColor(unsigned char* data, unsigned int size, unsigned int index)
+struct Settings
 {
-    if (index > size - 1)
-        throw std::runtime_error("Image index out of bounds.");
+    std::vector<PaletteColor> Palette; //empty for grayscale shades
+    unsigned int Colors = 2;
+    float LuminanceMultiplier = 1.0f;
+    char Method = 'F';
+    float ErrorMultiplier = 1.0f;
+    bool AlphaToBlack = false;
+    bool Vertical = false;
+    bool Compress = false;
+};
 
-    unsigned int imageIndex = index * 4;
-    return { data[imageIndex], data[imageIndex + 1], data[imageIndex + 2], data[imageIndex + 3] };
+static bool IsYes(char answer)
+{
+    return answer == 'y' || answer == 'Y';
+}
+
+static bool IsMethod(char method)
+{
+    return method == 'F' || method == 'B' || method == 'N';
 }
 
-void AddColor(unsigned char* data, unsigned int size, unsigned int index, unsigned char x)
+static bool IsColorCount(unsigned int colors)
 {
-    auto [r, g, b, a] = GetColor(data, size, index);
-    r += x;
-    g += x;
-    b += x;
+    return colors >= 2 && colors <= 0xFF;
 }
 
-/*
-https://en.wikipedia.org/wiki/Floyd%E2%80%93Steinberg_dithering
-converts a r8g8b8a8 image (from 'data') to a grayscale image with the 'colors' colors using dithering (written back to 'data')
-if 'alphaToBlack' is set all of the transparent pixels will become black
-returns an array of bytes, each equal to pixel's color index, 0 for transparent pixels and higher values for lighter tones (e.g. with two colors white will be 1 and black will be 0)
-*/
-unsigned char* FloydSteinberg(
-    unsigned char* data,
-    unsigned int width,
-    unsigned int height,
-    unsigned int colors,
-    float luminanceMultiplier,
-    float errorMultiplier,
-    bool alphaToBlack)
+static bool ReadYesNo(std::istream& stream, bool& target)
 {
-    if (colors < 2 || colors > 0xFF)
-        throw std::runtime_error("Amount of colors should be in 2 - 255 range.");
+    char answer;
+    if (!(stream >> answer))
+        return false;
+
+    target = IsYes(answer);
+    return true;
+}
+
+static Settings AskSettings()
+{
+    Settings settings;
+    std::filesystem::path palettePath = {};
+    std::cout << "Palette file with block colors ('-' for grayscale shades): ";
+    std::cin >> palettePath;
+
+    if (palettePath == "-")
+    {
+        std::cout << "Color count: ";
+        std::cin >> settings.Colors;
+        if (!IsColorCount(settings.Colors))
+            throw std::runtime_error("Amount of colors should be in 2 - 255 range.");
+    }
+    else
+    {
+        settings.Palette = LoadPalette(palettePath);
+        settings.Colors = settings.Palette.size();
+    }
+
+    std::cout << "Luminance multiplier (if the image is too bright/dark): ";
+    std::cin >> settings.LuminanceMultiplier;
 
-    unsigned int size = width * height;
-    unsigned char* convertedData = new unsigned char[size];
-    unsigned char colorStep = 0xFF / (colors - 1);
+    std::cout << "Dithering method? (F - Floyd-Steinberg, B - Bayer ordered, N - blue noise ordered, ordered ones are faster but noisier) ";
+    std::cin >> settings.Method;
+    settings.Method = std::toupper(settings.Method);
+    if (!IsMethod(settings.Method))
+        throw std::runtime_error("Invalid dithering method.");
 
-    for (int i = 0; i < size; i++)
+    if (settings.Method == 'F')
     {
-        auto [r, g, b, a] = GetColor(data, size, i);
+        std::cout << "Error multiplier (1 diffuses all of the quantization error, lower values give less noise): ";
+        std::cin >> settings.ErrorMultiplier;
+    }
+
+    char answer;
+    std::cout << "Alpha to black? (Y/N) ";
+    std::cin >> answer;
+    settings.AlphaToBlack = IsYes(answer);
+
+    std::cout << "Vertical orientation? (Y/N) ";
+    std::cin >> answer;
+    settings.Vertical = IsYes(answer);
+
+    std::cout << "Compress output? (Y/N) ";
+    std::cin >> answer;
+    settings.Compress = IsYes(answer);
+    return settings;
+}
 
-        if (a == 0)
+//parameter file has a 'key = value' line for each of the settings which differ from the defaults, empty lines and lines starting with '#' are skipped
+//keys are palette (path, relative to the parameter file), colors, luminance, method (F/B/N), error, alpha_to_black, vertical and compress (Y/N)
+static Settings LoadSettings(const std::filesystem::path& path)
+{
+    std::ifstream file = std::ifstream(path);
+    if (!file)
+        throw std::runtime_error(std::format("Can't open the parameter file '{}'.", path.string()));
+
+    Settings settings;
+    std::string line;
+    for (unsigned int lineNumber = 1; std::getline(file, line); lineNumber++)
+    {
+        size_t separator = line.find('=');
+        std::istringstream keyStream = std::istringstream(line.substr(0, separator));
+        std::string key;
+        if (!(keyStream >> key) || key[0] == '#')
+            continue;
+        if (separator == std::string::npos)
+            throw std::runtime_error(std::format("Line {} of the parameter file should be 'key = value'.", lineNumber));
+
+        std::istringstream value = std::istringstream(line.substr(separator + 1));
+        bool valid;
+        if (key == "palette")
         {
-            if (alphaToBlack)
+            std::filesystem::path palettePath;
+            valid = static_cast<bool>(value >> palettePath);
+            if (valid && palettePath != "-")
             {
-                convertedData[i] = 1;
-                r = g = b = 0;
-                a = 0xFF;
-            }
-            else
-            {
-                convertedData[i] = 0;
+                settings.Palette = LoadPalette(path.parent_path() / palettePath);
+                settings.Colors = settings.Palette.size();
             }
+        }
+        else if (key == "colors")
+            valid = settings.Palette.empty() && static_cast<bool>(value >> settings.Colors) && IsColorCount(settings.Colors);
+        else if (key == "luminance")
+            valid = static_cast<bool>(value >> settings.LuminanceMultiplier);
+        else if (key == "method")
+        {
+            valid = static_cast<bool>(value >> settings.Method);
+            settings.Method = std::toupper(settings.Method);
+            valid = valid && IsMethod(settings.Method);
+        }
+        else if (key == "error")
+            valid = static_cast<bool>(value >> settings.ErrorMultiplier);
+        else if (key == "alpha_to_black")
+            valid = ReadYesNo(value, settings.AlphaToBlack);
+        else if (key == "vertical")
+            valid = ReadYesNo(value, settings.Vertical);
+        else if (key == "compress")
+            valid = ReadYesNo(value, settings.Compress);
+        else
+            throw std::runtime_error(std::format("Unknown key '{}' on line {} of the parameter file.", key, lineNumber));
 
-            continue;
+        if (!valid)
+            throw std::runtime_error(std::format("Invalid value of '{}' on line {} of the parameter file.", key, lineNumber));
+    }
+
+    return settings;
+}
+
+//dithers the image (the preview is written back to 'data') and returns the voxels of the model
+static unsigned char* Dither(unsigned char* data, unsigned int width, unsigned int height, const Settings& settings, unsigned int threads)
+{
+    if (settings.Method == 'F')
+    {
+        return settings.Palette.empty()
+            ? FloydSteinberg(data, width, height, settings.Colors, settings.LuminanceMultiplier, settings.ErrorMultiplier, settings.AlphaToBlack, threads)
+            : PaletteDither(data, width, height, settings.Palette, settings.LuminanceMultiplier, settings.ErrorMultiplier, settings.AlphaToBlack, threads);
+    }
+
+    ThresholdMap map = settings.Method == 'B' ? ThresholdMap::Bayer : ThresholdMap::BlueNoise;
+    return settings.Palette.empty()
+        ? OrderedDither(data, width, height, settings.Colors, settings.LuminanceMultiplier, settings.AlphaToBlack, map, threads)
+        : OrderedPaletteDither(data, width, height, settings.Palette, settings.LuminanceMultiplier, settings.AlphaToBlack, map, threads);
+}
+
+//converts an image to a model written to 'output', the dithered image is written to 'preview' unless it's empty
+static void ConvertImage(const std::filesystem::path& image, const std::filesystem::path& output, const std::filesystem::path& preview, const Settings& settings, unsigned int threads)
+{
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(settings.Vertical); //images are loaded on several threads in the batch mode
+    //image is freed even if dithering throws
+    std::unique_ptr<unsigned char, decltype(&stbi_image_free)> data = { stbi_load(image.string().c_str(), &width, &height, &channels, 4), &stbi_image_free };
+    if (!data)
+        throw std::runtime_error(std::format("Can't load '{}' ({}).", image.string(), stbi_failure_reason()));
+
+    unsigned char* convertedData = Dither(data.get(), width, height, settings, threads);
+    if (!preview.empty())
+        stbi_write_png(preview.string().c_str(), width, height, 4, data.get(), width * 4);
+    data.reset();
+
+    VoxelModel model = VoxelModel(width, settings.Vertical ? 1 : height, settings.Vertical ? height : 1, settings.Colors, convertedData);
+    model.WriteToFile(output, settings.Compress);
+}
+
+//'*' matches any amount of characters and '?' a single one
+static bool MatchesPattern(const std::string& name, const std::string& pattern)
+{
+    size_t n = 0, p = 0;
+    size_t starName = std::string::npos, starPattern = std::string::npos; //position after the last '*', name can be matched again from there
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+        {
+            n++;
+            p++;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            starPattern = ++p;
+            starName = n;
         }
+        else if (starPattern != std::string::npos)
+        {
+            p = starPattern;
+            n = ++starName;
+        }
+        else
+        {
+            return false;
+        }
+    }
 
-        //getting closest shade of gray
-        //https://en.wikipedia.org/wiki/Relative_luminance
-        float luminance =
-            (static_cast<float>(r) / 255.0f) * 0.2126f +
-            (static_cast<float>(g) / 255.0f) * 0.7152f +
-            (static_cast<float>(b) / 255.0f) * 0.0722f;
-        float colorLevel = luminance * luminanceMultiplier * colors;
-        unsigned char color = std::floor(colorLevel) * colorStep;
-
-        //passing quantization error
-        unsigned char quantizationError = (r + g + b - 3 * color) * errorMultiplier;
-
-        unsigned int index = i + 1; //right
-        if (index < size)
-            AddColor(data, size, index, quantizationError * 7 / 16);
-
-        index = i + width; //down
-        if (i + width < size)
-            AddColor(data, size, index, quantizationError * 5 / 16);
-
-        index = i + width - 1; //left & down
-        if (i + width - 1 < size)
-            AddColor(data, size, index, quantizationError * 3 / 16);
-
-        index = i + width + 1; //right & down
-        if (i + width + 1 < size)
-            AddColor(data, size, index, quantizationError / 16);
-
-        r = g = b = color;
-        a = 0xFF;
-        convertedData[i] = std::max(std::ceil(colorLevel), 1.0f);
+    while (p < pattern.size() && pattern[p] == '*')
+        p++;
+    return p == pattern.size();
+}
+
+//images in a directory or matching a pattern in the file name (e.g. 'frames/*.png'), largest files first
+static std::vector<std::filesystem::path> FindImages(const std::filesystem::path& path)
+{
+    const std::vector<std::string> extensions = { ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".psd", ".hdr", ".pic", ".pnm", ".ppm", ".pgm" };
+    bool directory = std::filesystem::is_directory(path);
+    std::filesystem::path parent = directory ? path : path.parent_path().empty() ? "." : path.parent_path();
+    std::string pattern = directory ? "*" : path.filename().string();
+
+    std::vector<std::filesystem::path> images;
+    for (auto& entry : std::filesystem::directory_iterator(parent))
+    {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (entry.is_regular_file() && MatchesPattern(entry.path().filename().string(), pattern) && std::find(extensions.begin(), extensions.end(), extension) != extensions.end())
+            images.push_back(entry.path());
     }
 
-    return convertedData;
+    //file size is a rough estimate of how long the conversion takes
+    std::vector<std::pair<uintmax_t, std::filesystem::path>> sized;
+    for (std::filesystem::path& image : images)
+        sized.emplace_back(std::filesystem::file_size(image), image);
+    std::sort(sized.begin(), sized.end(), [](auto& a, auto& b) { return a.first != b.first ? a.first > b.first : a.second < b.second; });
+    for (size_t i = 0; i < sized.size(); i++)
+        images[i] = sized[i].second;
+
+    //each image is written to a model with its name, two images with the same name would be written to the same file
+    std::vector<std::filesystem::path> stems;
+    for (std::filesystem::path& image : images)
+        stems.push_back(image.stem());
+    std::sort(stems.begin(), stems.end());
+    auto duplicate = std::adjacent_find(stems.begin(), stems.end());
+    if (duplicate != stems.end())
+        throw std::runtime_error(std::format("Several images are named '{}', each of them would be written to '{}.vox'.", duplicate->string(), duplicate->string()));
+
+    return images;
+}
+
+static void PrintMaterials(const Settings& settings)
+{
+    //materials have to be entered in this order when running vox2bin
+    if (!settings.Palette.empty())
+    {
+        std::cout << "Materials:\n";
+        for (size_t i = 0; i < settings.Palette.size(); i++)
+            std::cout << "Material " << i + 1 << ": " << settings.Palette[i].Name << "\n";
+    }
 }
 
 int main()
@@ -107,45 +287,70 @@ int main()
     std::cout << "== img2vox ==\n";
 
     std::filesystem::path path = {};
-    std::cout << "Image path: ";
+    std::cout << "Image path (a directory or a pattern like 'frames/*.png' converts all of the images): ";
     std::cin >> path;
 
-    if (!std::filesystem::exists(path))
+    std::string name = path.filename().string();
+    bool batch = std::filesystem::is_directory(path) || name.find_first_of("*?") != std::string::npos;
+    if (!batch && !std::filesystem::exists(path))
     {
         std::cout << "Invalid file path.";
         return -1;
     }
 
-    unsigned int colors;
-    std::cout << "Color count: ";
-    std::cin >> colors;
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    if (!batch)
+    {
+        Settings settings = AskSettings();
+        ConvertImage(path, "img2vox-output.vox", "img2vox-output.png", settings, cores);
+        PrintMaterials(settings);
+        return 0;
+    }
 
-    float luminanceMultiplier;
-    std::cout << "Luminance multiplier (if the image is too bright/dark): ";
-    std::cin >> luminanceMultiplier;
+    std::vector<std::filesystem::path> images = FindImages(path);
+    if (images.empty())
+    {
+        std::cout << "No images found.";
+        return -1;
+    }
 
-    float errorMultiplier;
-    std::cout << "Error multiplier (if the image is weird, typically in 0.001 - 0.005 range for small images): ";
-    std::cin >> errorMultiplier;
+    std::filesystem::path parameterPath = {};
+    std::cout << "Found " << images.size() << " images.\nParameter file ('-' to answer the questions instead): ";
+    std::cin >> parameterPath;
+    Settings settings = parameterPath == "-" ? AskSettings() : LoadSettings(parameterPath);
 
-    char alphaToBlack;
-    std::cout << "Alpha to black? (Y/N) ";
-    std::cin >> alphaToBlack;
-    alphaToBlack = alphaToBlack == 'y' || alphaToBlack == 'Y';
+    std::filesystem::path outputPath = {};
+    std::cout << "Output directory: ";
+    std::cin >> outputPath;
+    std::filesystem::create_directories(outputPath);
 
-    char vertical;
-    std::cout << "Vertical orientation? (Y/N) ";
-    std::cin >> vertical;
-    vertical = vertical == 'y' || vertical == 'Y';
+    //each image is converted on a single thread unless there are fewer images than cores
+    unsigned int workers = std::min<size_t>(cores, images.size());
+    unsigned int threadsPerImage = std::max(1u, cores / workers);
+    std::mutex outputMutex;
+    unsigned int converted = 0;
+    StealingFor(images.size(), workers, [&](unsigned int i, unsigned int)
+    {
+        std::filesystem::path output = outputPath / images[i].filename().replace_extension(".vox");
+        std::string message;
+        bool succeeded = true;
+        try
+        {
+            ConvertImage(images[i], output, {}, settings, threadsPerImage);
+            message = std::format("{} -> {}\n", images[i].string(), output.string());
+        }
+        catch (const std::exception& e)
+        {
+            message = std::format("{} failed: {}\n", images[i].string(), e.what());
+            succeeded = false;
+        }
 
-    int width, height, channels;
-    stbi_set_flip_vertically_on_load(vertical);
-    unsigned char* data = stbi_load(path.string().c_str(), &width, &height, &channels, 4);
-    unsigned char* convertedData = FloydSteinberg(data, width, height, colors, luminanceMultiplier, errorMultiplier, alphaToBlack);
-    stbi_write_png("img2vox-output.png", width, height, 4, data, width * 4);
-    VoxelModel model = VoxelModel(width, vertical ? 1 : height, vertical ? height : 1, colors, convertedData);
-    model.WriteToFile("img2vox-output.vox");
-
-    delete[] data;
+        std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(outputMutex);
+        converted += succeeded;
+        std::cout << message;
+    });
+
+    std::cout << "Converted " << converted << " of " << images.size() << " images.\n";
+    PrintMaterials(settings);
     return 0;
 }
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "palette.hpp"
+
+//lookup box, Oklab colors of sRGB are within L 0 - 1, A -0.24 - 0.28, B -0.32 - 0.2
+const float MinL = 0.0f;
+const float MaxL = 1.0f;
+const float MinAB = -0.4f;
+const float MaxAB = 0.4f;
+const unsigned int LookupCells = 32; //cells along each axis
+const float CellPadding = 0.0001f;
+
+std::vector<PaletteColor> LoadPalette(const std::filesystem::path& path)
+{
+    std::ifstream file = std::ifstream(path);
+    if (!file)
+        throw std::runtime_error(std::format("Can't open the palette file '{}'.", path.string()));
+
+    std::vector<PaletteColor> palette;
+    std::string line;
+    for (unsigned int lineNumber = 1; std::getline(file, line); lineNumber++)
+    {
+        std::istringstream stream = std::istringstream(line);
+        std::string name;
+        if (!(stream >> name) || name[0] == '#')
+            continue;
+
+        int rgb[3];
+        if (!(stream >> rgb[0] >> rgb[1] >> rgb[2]) || std::any_of(rgb, rgb + 3, [](int c) { return c < 0 || c > 0xFF; }))
+            throw std::runtime_error(std::format("Line {} of the palette should contain a block name and its red, green and blue (0 - 255) values.", lineNumber));
+
+        PaletteColor color;
+        color.Name = name;
+        for (int c = 0; c < 3; c++)
+            color.Rgb[c] = static_cast<unsigned char>(rgb[c]);
+        color.Color = ToLab(color.Rgb);
+        palette.push_back(color);
+    }
+
+    if (palette.empty() || palette.size() > MaxPaletteSize)
+        throw std::runtime_error(std::format("Palette should contain 1 - {} colors.", MaxPaletteSize));
+    return palette;
+}
+
+//sRGB transfer function is undone with a table, there are only 256 values
+static const std::array<float, 0x100>& GetLinearTable()
+{
+    static const std::array<float, 0x100> table = []()
+    {
+        std::array<float, 0x100> linear;
+        for (int i = 0; i < 0x100; i++)
+        {
+            float c = i / 255.0f;
+            linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        return linear;
+    }();
+
+    return table;
+}
+
+//std::cbrt is a library call, this is a few times faster and accurate to a few ulps
+static float CubeRoot(float value)
+{
+    if (value <= 0.0f)
+        return 0.0f;
+
+    //exponent divided by three gives a guess within a few percent, newton's method then doubles the correct digits each iteration
+    float root = std::bit_cast<float>(std::bit_cast<uint32_t>(value) / 3 + 709921077);
+    for (int i = 0; i < 3; i++)
+        root -= (root * root * root - value) / (3.0f * root * root);
+    return root;
+}
+
+Lab ToLab(const unsigned char* rgb, float multiplier)
+{
+    const std::array<float, 0x100>& linear = GetLinearTable();
+    float r = linear[rgb[0]] * multiplier;
+    float g = linear[rgb[1]] * multiplier;
+    float b = linear[rgb[2]] * multiplier;
+
+    float l = CubeRoot(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+    float m = CubeRoot(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+    float s = CubeRoot(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+
+    Lab lab;
+    lab.L = 0.2104542553f * l + 0.7936177850f * m - 0.0040720640f * s;
+    lab.A = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+    lab.B = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+    return lab;
+}
+
+static float Square(float value)
+{
+    return value * value;
+}
+
+//squared distances from 'value' to the closest and the furthest point of the [low, high] range
+static void GetRangeDistances(float value, float low, float high, float& nearest, float& furthest)
+{
+    nearest = value < low ? Square(low - value) : value > high ? Square(value - high) : 0.0f;
+    furthest = std::max(Square(value - low), Square(value - high));
+}
+
+static unsigned int GetCell(float value, float min, float max)
+{
+    const float scale = LookupCells / (max - min);
+    return std::min(static_cast<unsigned int>((value - min) * scale), LookupCells - 1);
+}
+
+PaletteLookup::PaletteLookup(const std::vector<PaletteColor>& palette) : Palette(palette)
+{
+    const float sizeL = (MaxL - MinL) / LookupCells;
+    const float sizeAB = (MaxAB - MinAB) / LookupCells;
+    std::vector<float> nearest = std::vector<float>(palette.size());
+
+    CellCandidates.reserve(LookupCells * LookupCells * LookupCells + 1);
+    for (unsigned int l = 0; l < LookupCells; l++)
+    {
+        for (unsigned int a = 0; a < LookupCells; a++)
+        {
+            for (unsigned int b = 0; b < LookupCells; b++)
+            {
+                //colors which are closer to the cell than the furthest point of the cell from the best color
+                //cells are padded a bit so that rounding can't put a color into a cell it's just outside of
+                float threshold = INFINITY;
+                for (size_t i = 0; i < palette.size(); i++)
+                {
+                    const Lab& c = palette[i].Color;
+                    float nearL, farL, nearA, farA, nearB, farB;
+                    GetRangeDistances(c.L, MinL + l * sizeL - CellPadding, MinL + (l + 1) * sizeL + CellPadding, nearL, farL);
+                    GetRangeDistances(c.A, MinAB + a * sizeAB - CellPadding, MinAB + (a + 1) * sizeAB + CellPadding, nearA, farA);
+                    GetRangeDistances(c.B, MinAB + b * sizeAB - CellPadding, MinAB + (b + 1) * sizeAB + CellPadding, nearB, farB);
+                    nearest[i] = nearL + nearA + nearB;
+                    threshold = std::min(threshold, farL + farA + farB);
+                }
+
+                CellCandidates.push_back(static_cast<unsigned int>(Candidates.size()));
+                for (size_t i = 0; i < palette.size(); i++)
+                {
+                    if (nearest[i] <= threshold)
+                    {
+                        Candidates.push_back(static_cast<unsigned char>(i));
+                        CandidateColors.push_back(palette[i].Color);
+                    }
+                }
+            }
+        }
+    }
+
+    CellCandidates.push_back(static_cast<unsigned int>(Candidates.size()));
+}
+
+Lab PaletteLookup::Clamp(Lab color)
+{
+    color.L = std::clamp(color.L, MinL, MaxL);
+    color.A = std::clamp(color.A, MinAB, MaxAB);
+    color.B = std::clamp(color.B, MinAB, MaxAB);
+    return color;
+}
+
+unsigned int PaletteLookup::Nearest(Lab color) const
+{
+    unsigned int cell = (GetCell(color.L, MinL, MaxL) * LookupCells + GetCell(color.A, MinAB, MaxAB)) * LookupCells + GetCell(color.B, MinAB, MaxAB);
+    unsigned int best = 0;
+    float bestDistance = INFINITY;
+    for (unsigned int i = CellCandidates[cell]; i < CellCandidates[cell + 1]; i++)
+    {
+        //written without branches, which of the candidates is the closest is hard to predict
+        const Lab& c = CandidateColors[i];
+        float distance = Square(c.L - color.L) + Square(c.A - color.A) + Square(c.B - color.B);
+        bool closer = distance < bestDistance;
+        best = closer ? Candidates[i] : best;
+        bestDistance = closer ? distance : bestDistance;
+    }
+
+    return best;
+}
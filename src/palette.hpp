@@ -0,0 +1,48 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+const unsigned int MaxPaletteSize = 254; //material 255 is reserved for removing blocks
+
+//https://bottosson.github.io/posts/oklab/
+//perceptual color space, euclidean distance between two colors is close to how different they look
+struct Lab
+{
+    float L;
+    float A;
+    float B;
+};
+
+struct PaletteColor
+{
+    std::string Name; //block name, entered as the material when running vox2bin
+    unsigned char Rgb[3];
+    Lab Color;
+};
+
+//palette file has one color per line: block name followed by red, green and blue (0 - 255), e.g. 'minecraft:white_concrete 207 213 214'
+//empty lines and lines starting with '#' are skipped, colors become materials in the order they are listed (first one is material 1)
+std::vector<PaletteColor> LoadPalette(const std::filesystem::path& path);
+
+//converts a r8g8b8 (sRGB) color, linear values are multiplied by 'multiplier'
+Lab ToLab(const unsigned char* rgb, float multiplier = 1.0f);
+
+//finds the nearest palette color of any color inside of the lookup box
+//box is split into cells, each one stores all of the colors which can be the nearest to some point of the cell, so the result is exact
+struct PaletteLookup
+{
+    const std::vector<PaletteColor>& Palette;
+    std::vector<unsigned int> CellCandidates; //offset of each cell's candidates, one more than the cell count
+    std::vector<unsigned char> Candidates;
+    std::vector<Lab> CandidateColors; //copies of the candidates' colors, so that they are read in order
+
+    PaletteLookup(const std::vector<PaletteColor>& palette);
+
+    //clamps the color to the lookup box, which holds all of the sRGB colors with some margin
+    //diffused error can push colors far outside of it, after clamping the error can't keep growing
+    static Lab Clamp(Lab color);
+
+    //index of the nearest palette color, 'color' has to be inside of the lookup box
+    unsigned int Nearest(Lab color) const;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//calls 'fn' with each index from [begin, end) and the number of the thread calling it, indices are handed out to threads as they finish
+template<typename Fn>
+void ParallelFor(unsigned int begin, unsigned int end, unsigned int threadCount, Fn fn)
+{
+	std::atomic<unsigned int> next = begin;
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < std::min(threadCount, end - begin); t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (unsigned int i = next++; i < end; i = next++)
+				fn(i, t);
+		});
+	}
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+//calls 'fn' with each index from [0, count) and the number of the thread calling it, for tasks which take very different amounts of time
+//indices are dealt to the threads' queues in order (so the largest tasks should come first), each thread takes tasks from the front of its own queue
+//and once it's empty steals from the back of the others' queues, tasks are never added so all queues being empty means there's nothing left
+template<typename Fn>
+void StealingFor(unsigned int count, unsigned int threadCount, Fn fn)
+{
+	struct Queue
+	{
+		std::mutex Mutex;
+		std::deque<unsigned int> Tasks;
+	};
+
+	threadCount = std::max(1u, std::min(threadCount, count));
+	std::vector<Queue> queues = std::vector<Queue>(threadCount);
+	for (unsigned int i = 0; i < count; i++)
+		queues[i % threadCount].Tasks.push_back(i);
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < threadCount && count > 0; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			while (true)
+			{
+				bool found = false;
+				unsigned int task;
+				for (unsigned int k = 0; k < threadCount && !found; k++)
+				{
+					Queue& queue = queues[(t + k) % threadCount];
+					std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(queue.Mutex);
+					if (queue.Tasks.empty())
+						continue;
+
+					found = true;
+					task = k == 0 ? queue.Tasks.front() : queue.Tasks.back();
+					if (k == 0)
+						queue.Tasks.pop_front();
+					else
+						queue.Tasks.pop_back();
+				}
+
+				if (!found)
+					return;
+				fn(task, t);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
@@ -0,0 +1,319 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <string>
+#include <format>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include "planner.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+const unsigned int Sizes[] = { 16, 32, 64 };
+const unsigned int Seed = 12345;
+const unsigned int OptimizedTourBudget = 10;
+const long long StartFuel = 100; //enough to get to the refill position
+
+struct BenchResult
+{
+	std::string Model;
+	unsigned int Size;
+	std::string Planner;
+	unsigned int Width;
+	unsigned int Length;
+	unsigned int Height;
+	unsigned long long Voxels;
+	double PlanningMs;
+	unsigned long long PeakMemoryKb; //peak added by planning to the memory the process used right before it
+	unsigned long long InstructionBytes;
+	unsigned long long Moves;
+	unsigned long long Turns;
+	unsigned int Refills;
+};
+
+//models are generated from a fixed seed so every run plans the same voxels
+std::unique_ptr<VoxelModel> GenerateModel(std::string name, unsigned int size)
+{
+	std::mt19937 random = std::mt19937(Seed + size);
+	std::unique_ptr<VoxelModel> model;
+	auto fill = [&](std::function<unsigned char(int, int, int)> voxel)
+	{
+		for (unsigned int z = 0; z < model->Height; z++)
+			for (unsigned int y = 0; y < model->Length; y++)
+				for (unsigned int x = 0; x < model->Width; x++)
+					model->Set(x, y, z, voxel(x, y, z));
+	};
+
+	if (name == "solid cube")
+	{
+		model = std::make_unique<VoxelModel>(size, size, size, 1, VoxelStorage::Owned);
+		fill([](int, int, int) { return 1; });
+	}
+	else if (name == "hollow sphere")
+	{
+		model = std::make_unique<VoxelModel>(size, size, size, 3, VoxelStorage::Owned);
+		double r = size / 2.0;
+		fill([&](int x, int y, int z)
+		{
+			double dx = x + 0.5 - r, dy = y + 0.5 - r, dz = z + 0.5 - r;
+			double d = std::sqrt(dx * dx + dy * dy + dz * dz);
+			return static_cast<unsigned char>(d <= r && d > r - 1.5 ? 1 + z * 3 / size : 0);
+		});
+	}
+	else if (name == "pixel art noise")
+	{
+		//short runs of random materials with holes, like a dithered image
+		model = std::make_unique<VoxelModel>(size * 4, size * 4, 2, 8, VoxelStorage::Owned);
+		unsigned char mat = 0;
+		fill([&](int, int, int)
+		{
+			if (random() % 4 == 0)
+				mat = random() % 3 == 0 ? 0 : 1 + random() % 8;
+			return mat;
+		});
+	}
+	else if (name == "color regions")
+	{
+		//image with many colors, only a few of them used in each part of it
+		model = std::make_unique<VoxelModel>(size * 4, size * 4, 2, 12, VoxelStorage::Owned);
+		fill([](int x, int y, int) { return static_cast<unsigned char>(1 + (x / 8 + y / 24) % 12); });
+	}
+	else if (name == "thin walls")
+	{
+		model = std::make_unique<VoxelModel>(size, size, size, 2, VoxelStorage::Owned);
+		fill([](int x, int y, int) { return static_cast<unsigned char>(x % 8 == 0 ? 1 : y % 8 == 0 ? 2 : 0); });
+	}
+	else if (name == "tiny islands")
+	{
+		model = std::make_unique<VoxelModel>(size * 2, size * 2, size / 4, 4, VoxelStorage::Owned);
+		fill([&](int, int, int) { return static_cast<unsigned char>(random() % 20 == 0 ? 1 + random() % 4 : 0); });
+	}
+	else if (name == "tall tower")
+	{
+		unsigned int side = std::max(4u, size / 4);
+		model = std::make_unique<VoxelModel>(side, side, size * 4, 1, VoxelStorage::Owned);
+		int last = static_cast<int>(side - 1);
+		fill([&](int x, int y, int) { return static_cast<unsigned char>(x == 0 || y == 0 || x == last || y == last); });
+	}
+
+	return model;
+}
+
+//resets the peak to the current usage so that only the following work is measured (on linux)
+//heap kept by earlier runs is returned to the system first, otherwise it would stay in the current usage and hide smaller peaks
+void ResetPeakMemory()
+{
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+#ifndef _WIN32
+	std::ofstream file = std::ofstream("/proc/self/clear_refs");
+	file << "5";
+#endif
+}
+
+//current or peak memory usage of the process
+unsigned long long GetMemoryKb(bool peak)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return (peak ? counters.PeakWorkingSetSize : counters.WorkingSetSize) / 1024;
+#else
+	std::ifstream file = std::ifstream("/proc/self/status");
+	std::string key = peak ? "VmHWM:" : "VmRSS:";
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.rfind(key, 0) == 0)
+			return std::stoull(line.substr(key.size()));
+	}
+	return 0;
+#endif
+}
+
+//counts moves and turns the turtle would make (repeat instructions included)
+void CountMoves(std::vector<unsigned char>& instructions, unsigned long long& moves, unsigned long long& turns)
+{
+	moves = turns = 0;
+	for (size_t i = 0; i < instructions.size(); i++)
+	{
+		unsigned char action = instructions[i];
+		unsigned int count = 1;
+		switch (action)
+		{
+		case TurtleAction::Repeat:
+			action = instructions[i + 1];
+			count = instructions[i + 2];
+			i += 2;
+			break;
+		case TurtleAction::Request:
+			i += 2;
+			break;
+		case TurtleAction::RequestBatch:
+			i += 1 + instructions[i + 1] * 3;
+			break;
+		case TurtleAction::SelectSlot:
+		case TurtleAction::Unload:
+		case TurtleAction::Refuel:
+			i++;
+			break;
+		}
+
+		if (action >= TurtleAction::Forward && action <= TurtleAction::Down)
+			moves += count;
+		else if (action == TurtleAction::TurnLeft || action == TurtleAction::TurnRight)
+			turns += count;
+	}
+}
+
+BenchResult RunBench(std::string name, unsigned int size, std::string planner)
+{
+	std::unique_ptr<VoxelModel> model = GenerateModel(name, size);
+	BenchResult result = BenchResult();
+	result.Model = name;
+	result.Size = size;
+	result.Planner = planner;
+	result.Width = model->Width;
+	result.Length = model->Length;
+	result.Height = model->Height;
+	for (size_t i = 0; i < model->GetSize(); i++)
+		result.Voxels += model->Data[i] != 0;
+
+	TourBudget = planner == "greedy" ? 0 : OptimizedTourBudget;
+	MultiLayer = planner != "greedy";
+	ScheduleRefills = planner != "greedy";
+	PlanningThreads = planner == "greedy" ? 1 : std::max(1u, std::thread::hardware_concurrency());
+
+	//model is placed next to the turtle, with a single refill point behind it
+	Turtle turtle = Turtle();
+	turtle.FuelLevel = StartFuel;
+	BuildState state;
+	state.MaxX = model->Width;
+	state.Refills = { Vec3i(-2, -2, 0) };
+
+	ResetPeakMemory();
+	unsigned long long baseMemory = GetMemoryKb(false);
+	auto begin = std::chrono::steady_clock::now();
+	BuildModel(turtle, state, *model, Vec3i(1, 1, 0));
+	auto end = std::chrono::steady_clock::now();
+
+	result.PlanningMs = std::chrono::duration<double, std::milli>(end - begin).count();
+	unsigned long long peakMemory = GetMemoryKb(true);
+	result.PeakMemoryKb = peakMemory > baseMemory ? peakMemory - baseMemory : 0;
+	result.InstructionBytes = turtle.GetInstructionCount();
+	CountMoves(turtle.Instructions, result.Moves, result.Turns);
+	result.Refills = state.RefillCount;
+	return result;
+}
+
+//quotes, backslashes and control characters are escaped
+std::string EscapeJson(const std::string& str)
+{
+	std::string escaped;
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if (static_cast<unsigned char>(c) < 0x20)
+			escaped += std::format("\\u{:04x}", static_cast<int>(c));
+		else
+			escaped += c;
+	}
+	return escaped;
+}
+
+//fields with separators, quotes or line breaks are quoted, quotes inside of them are doubled
+std::string EscapeCsv(const std::string& str)
+{
+	if (str.find_first_of(",\"\r\n") == std::string::npos)
+		return str;
+
+	std::string escaped = "\"";
+	for (char c : str)
+		escaped += c == '"' ? "\"\"" : std::string(1, c);
+	return escaped + "\"";
+}
+
+void WriteJson(std::ostream& file, std::string label, std::vector<BenchResult>& results)
+{
+	file << "{\n  \"label\": \"" << EscapeJson(label) << "\",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		BenchResult& r = results[i];
+		file << "    { \"model\": \"" << r.Model << "\", \"size\": " << r.Size << ", \"planner\": \"" << r.Planner << "\", "
+			<< "\"dimensions\": [" << r.Width << ", " << r.Length << ", " << r.Height << "], \"voxels\": " << r.Voxels << ", "
+			<< "\"planning_ms\": " << r.PlanningMs << ", \"peak_memory_kb\": " << r.PeakMemoryKb << ", "
+			<< "\"instruction_bytes\": " << r.InstructionBytes << ", \"moves\": " << r.Moves << ", \"turns\": " << r.Turns << ", "
+			<< "\"refills\": " << r.Refills << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n}\n";
+}
+
+void WriteCsv(std::ostream& file, std::string label, std::vector<BenchResult>& results)
+{
+	file << "label,model,size,planner,width,length,height,voxels,planning_ms,peak_memory_kb,instruction_bytes,moves,turns,refills\n";
+	for (BenchResult& r : results)
+	{
+		file << EscapeCsv(label) << "," << r.Model << "," << r.Size << "," << r.Planner << "," << r.Width << "," << r.Length << "," << r.Height << ","
+			<< r.Voxels << "," << r.PlanningMs << "," << r.PeakMemoryKb << "," << r.InstructionBytes << "," << r.Moves << ","
+			<< r.Turns << "," << r.Refills << "\n";
+	}
+}
+
+int main()
+{
+	std::cout << "== planbench ==\n";
+
+	std::string label;
+	std::cout << "Run label (e.g. git revision): ";
+	std::getline(std::cin, label);
+
+	std::string path;
+	std::cout << "Results file (.json or .csv, empty string to only print them): ";
+	std::getline(std::cin, path);
+
+	const char* models[] = { "solid cube", "hollow sphere", "pixel art noise", "color regions", "thin walls", "tiny islands", "tall tower" };
+	const char* planners[] = { "greedy", "optimized" };
+
+	std::vector<BenchResult> results;
+	for (const char* name : models)
+	{
+		for (unsigned int size : Sizes)
+		{
+			for (const char* planner : planners)
+			{
+				results.push_back(RunBench(name, size, planner));
+				BenchResult& r = results.back();
+				std::cout << r.Model << " " << r.Size << " (" << r.Planner << "): " << r.PlanningMs << " ms, " << r.PeakMemoryKb << " KB peak, "
+					<< r.InstructionBytes << " bytes, " << r.Moves << " moves, " << r.Turns << " turns, " << r.Refills << " refills\n";
+			}
+		}
+	}
+
+	if (!path.empty())
+	{
+		std::ofstream file = std::ofstream(path);
+		if (!file.is_open())
+			throw std::runtime_error("Failed to create results file.");
+
+		if (path.ends_with(".csv"))
+			WriteCsv(file, label, results);
+		else
+			WriteJson(file, label, results);
+		std::cout << "Results written to '" << path << "'.\n";
+	}
+
+	return 0;
+}
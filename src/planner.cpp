@@ -0,0 +1,692 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "planner.hpp"
+#include "runs.hpp"
+#include "tour.hpp"
+
+unsigned int TourBudget;
+bool MultiLayer;
+bool ScheduleRefills;
+unsigned int PlanningThreads = 1;
+
+const unsigned int LayersAheadPerThread = 4; //layers prepared ahead of the turtle, enough to keep the threads busy while the turtle catches up
+
+const unsigned char* GetLayer(BuildState& state, VoxelModel& model, unsigned int z)
+{
+	if (model.IsDense())
+		return model.GetLayer(z);
+
+	if (state.BufferedLayer != z)
+	{
+		state.Layer.resize(model.GetLayerSize());
+		model.CopyLayer(z, state.Layer.data());
+		state.BufferedLayer = z;
+	}
+
+	return state.Layer.data();
+}
+
+void WriteRefillBlock(Turtle& turtle, BuildState& state)
+{
+	//all slots are requested at once, provider fulfills them in a single pass
+	unsigned char block[RefillBlockSize] = {};
+	unsigned char* b = block + 2;
+	for (int i = 0; i < InventorySize; i++)
+	{
+		if (!state.ItemCount[i])
+			continue;
+
+		b[0] = i + 1;
+		b[1] = state.Materials[i] + 1;
+		b[2] = state.ItemCount[i];
+		b += 3;
+		block[1]++;
+	}
+
+	if (block[1] > 0)
+		block[0] = TurtleAction::RequestBatch;
+
+	//block may be already flushed to the output file when streaming
+	turtle.PatchInstructions(state.RefillBlockBeginning, block, sizeof(block));
+}
+
+Vec3i GetNearestRefill(BuildState& state, Vec3i pos)
+{
+	Vec3i nearestRefill;
+	unsigned int minDist = std::numeric_limits<unsigned int>().max();
+	for (Vec3i refill : state.Refills)
+	{
+		unsigned int dist = (refill - pos).LengthLinear();
+		if (dist < minDist)
+		{
+			minDist = dist;
+			nearestRefill = refill;
+		}
+	}
+
+	return nearestRefill;
+}
+
+void RefillTurtle(Turtle& turtle, BuildState& state, VoxelModel& model)
+{
+	Vec3i oldPos = turtle.Pos;
+	TurtleRotation oldRotation = turtle.Rotation;
+	Vec3i travelPos = Vec3i(oldPos.X, oldPos.Y, std::max(oldPos.Z, state.TravelHeight));
+	turtle.MoveToGlobal(travelPos);
+	turtle.MoveToGlobal(GetNearestRefill(state, travelPos), false);
+
+	//fuel needed to get to the next refill is requested into the first slot, it's known once the turtle gets there
+	turtle.ReserveRefuel(model.MaterialCount + 1); //last material + 1 = fuel
+
+	state.RefillBlockBeginning = turtle.GetInstructionCount();
+	turtle.WriteByte(TurtleAction::None, RefillBlockSize);
+	turtle.MoveToGlobal(travelPos, true);
+	turtle.MoveToGlobal(oldPos, false, static_cast<RotationRequest>(oldRotation)); //turtle may be refilling right before placing a block in front of it
+	turtle.SelectedSlot = 0;
+
+	//materials get their slots once they're used
+	state.SlotsUsed = 0;
+	memset(state.ItemCount, 0, sizeof(state.ItemCount));
+	memset(state.Materials, 0, sizeof(state.Materials));
+	memset(state.CurrentSlot, NoSlot, sizeof(state.CurrentSlot));
+
+	state.RefillCount++;
+}
+
+//reports a possible refill at the turtle's position to the scheduler, with the cost of the trip there and back
+void AddRefill(Turtle& turtle, BuildState& state, bool forced)
+{
+	Vec3i travelPos = Vec3i(turtle.Pos.X, turtle.Pos.Y, std::max(turtle.Pos.Z, state.TravelHeight));
+	Vec3i trip = (GetNearestRefill(state, travelPos) - travelPos).Abs();
+	unsigned int climb = travelPos.Z - turtle.Pos.Z;
+	unsigned long long cost = 2ull * ((trip.X + trip.Y) * turtle.Costs.Move + (trip.Z + climb) * turtle.Costs.Vertical);
+	state.Scheduler->AddRefill(turtle.Moves, trip.X + trip.Y + trip.Z + climb, cost, forced);
+}
+
+//returns the slot to place the material from, slots are handed out in the order materials are used so each refill requests only
+//materials used until the next one, split into as many stacks as they need, when there's no free slot for the material turtle refills first
+unsigned char UseMaterial(Turtle& turtle, BuildState& state, VoxelModel& model, unsigned char mat)
+{
+	mat = mat - 1; //material 0 is void so first material will have index 0 thus we need to subtract 1
+	if (state.Scheduler)
+	{
+		if (state.Scheduler->UseItem(mat))
+		{
+			AddRefill(turtle, state, true);
+			state.Scheduler->UseItem(mat);
+		}
+		return 0;
+	}
+
+	unsigned char slot = state.CurrentSlot[mat];
+	if (slot == NoSlot)
+	{
+		if (state.SlotsUsed == InventorySize)
+		{
+			WriteRefillBlock(turtle, state);
+			RefillTurtle(turtle, state, model);
+		}
+
+		slot = state.SlotsUsed++;
+		state.CurrentSlot[mat] = slot;
+		state.Materials[slot] = mat;
+	}
+
+	if (++state.ItemCount[slot] == StackSize)
+		state.CurrentSlot[mat] = NoSlot; //next item of the material will need a new slot
+
+	return slot;
+}
+
+//point at which the turtle may go refill (when refills are scheduled), the dry run reports it to the scheduler, the real run refills there
+//if it's in the schedule
+void RefillPoint(Turtle& turtle, BuildState& state, VoxelModel& model)
+{
+	if (state.Scheduler)
+	{
+		AddRefill(turtle, state, false);
+		return;
+	}
+
+	if (state.NextRefill < state.RefillSchedule.size() && state.RefillSchedule[state.NextRefill] == state.RefillPoints)
+	{
+		if (state.RefillCount > 0) //first refill is the one the build starts with
+			WriteRefillBlock(turtle, state);
+		RefillTurtle(turtle, state, model);
+		state.NextRefill++;
+	}
+
+	state.RefillPoints++;
+}
+
+//tours planned during the dry run are reused by the real one, planning them again could give different tours (it's time limited)
+std::vector<TourStop> GetTour(BuildState& state, const LayerIslands& layer, Vec3i start)
+{
+	if (!state.Scheduler && state.NextTour < state.Tours.size())
+		return std::move(state.Tours[state.NextTour++]);
+
+	std::vector<TourStop> tour = PlanTour(layer.Graph, start, TourBudget);
+	if (state.Scheduler)
+		state.Tours.push_back(tour);
+	return tour;
+}
+
+//union-find over row ranges, roots are always the first range of the island (in scanning order)
+unsigned int FindRoot(std::vector<unsigned int>& parents, unsigned int i)
+{
+	while (parents[i] != i)
+	{
+		parents[i] = parents[parents[i]]; //path halving
+		i = parents[i];
+	}
+
+	return i;
+}
+
+void UniteRanges(std::vector<unsigned int>& parents, unsigned int a, unsigned int b)
+{
+	a = FindRoot(parents, a);
+	b = FindRoot(parents, b);
+	if (a < b)
+		parents[b] = a;
+	else
+		parents[a] = b;
+}
+
+std::vector<std::vector<Vec3i>> GetIslands(
+	BuildState& state,
+	VoxelModel& model,
+	const unsigned char* layer,
+	Vec3i offset,
+	unsigned int z,
+	unsigned int layers)
+{
+	std::vector<Run> runs;
+	std::vector<Vec3i> ranges; //range X - start X coordinate, Z - end X coordinate, Y - Y coordinate
+	std::vector<unsigned int> parents;
+	unsigned int prevRowBegin = 0; //ranges of the previous row
+	unsigned int prevRowEnd = 0;
+	for (int y = 0; y < model.Length; y++)
+	{
+		unsigned int rowBegin = ranges.size();
+
+		bool skip = true;
+		for (unsigned int l = z; l < z + layers && skip; l++)
+			skip = model.CanSkipRow(y, l);
+
+		if (skip)
+		{
+			prevRowBegin = prevRowEnd = rowBegin;
+			continue;
+		}
+
+		int wy = model.Length - y + offset.Y - 1;
+		runs.clear();
+		FindRuns(layer + static_cast<size_t>(model.Width) * y + state.MinX, state.MaxX - state.MinX, runs);
+		for (Run run : runs)
+			ranges.push_back(Vec3i(run.Start + state.MinX + offset.X, wy, run.End + state.MinX + offset.X));
+
+		for (unsigned int i = rowBegin; i < ranges.size(); i++)
+			parents.push_back(i);
+
+		//first pass, ranges overlapping ranges from the previous row belong to the same island (both rows are sorted by X)
+		unsigned int p = prevRowBegin;
+		for (unsigned int c = rowBegin; c < ranges.size(); c++)
+		{
+			while (p < prevRowEnd && ranges[p].Z < ranges[c].X)
+				p++;
+
+			for (unsigned int q = p; q < prevRowEnd && ranges[q].X <= ranges[c].Z; q++)
+				UniteRanges(parents, q, c);
+		}
+
+		prevRowBegin = rowBegin;
+		prevRowEnd = ranges.size();
+	}
+
+	//second pass, grouping ranges by their roots
+	std::vector<std::vector<Vec3i>> islands;
+	std::vector<unsigned int> islandIndex = std::vector<unsigned int>(ranges.size());
+	for (unsigned int i = 0; i < ranges.size(); i++)
+	{
+		unsigned int root = FindRoot(parents, i);
+		if (root == i)
+		{
+			islandIndex[i] = islands.size();
+			islands.emplace_back();
+		}
+
+		islands[islandIndex[root]].push_back(ranges[i]);
+	}
+
+	return islands;
+}
+
+//only tours which are going to be improved need the neighbours, the real run reuses tours of the dry run
+bool NeedsTourNeighbours(BuildState& state)
+{
+	return TourBudget > 0 && (state.Scheduler || state.Tours.empty());
+}
+
+LayerIslands FindLayerIslands(
+	BuildState& state,
+	VoxelModel& model,
+	Vec3i offset,
+	unsigned int z,
+	unsigned int layers,
+	bool tourNeighbours,
+	std::vector<unsigned char>& buffer)
+{
+	const unsigned char* layer;
+	size_t layerSize = model.GetLayerSize();
+	if (layers == 1 && model.IsDense())
+	{
+		layer = model.Data + z * layerSize;
+	}
+	else
+	{
+		//combined layer is non-empty where any of the layers is
+		buffer.resize(layerSize * 2);
+		model.CopyLayer(z, buffer.data());
+		for (unsigned int l = z + 1; l < z + layers; l++)
+		{
+			model.CopyLayer(l, buffer.data() + layerSize);
+			for (size_t i = 0; i < layerSize; i++)
+				buffer[i] |= buffer[layerSize + i];
+		}
+		layer = buffer.data();
+	}
+
+	LayerIslands found;
+	found.Islands = GetIslands(state, model, layer, offset, z, layers);
+	found.Graph = GetTourGraph(found.Islands, tourNeighbours);
+	return found;
+}
+
+PreparedLayer PrepareLayer(BuildState& state, VoxelModel& model, Vec3i offset, unsigned int z, bool tourNeighbours, std::vector<unsigned char>& buffer)
+{
+	PreparedLayer prepared;
+	if (model.CanSkipLayer(z))
+		return prepared;
+
+	prepared.Single = FindLayerIslands(state, model, offset, z, 1, tourNeighbours, buffer);
+	if (MultiLayer && z + 1 < model.Height && !model.CanSkipLayer(z + 1))
+		prepared.Pair = FindLayerIslands(state, model, offset, z, 2, tourNeighbours, buffer);
+	return prepared;
+}
+
+//prepares layers ahead of the turtle on 'PlanningThreads' threads, layers are handed out in order and kept until the turtle is done with them
+//islands don't depend on the turtle, only its path does (which is still planned one layer after another), so the output doesn't change
+struct LayerPreparer
+{
+	BuildState& State;
+	VoxelModel& Model;
+	Vec3i Offset;
+	bool TourNeighbours;
+	unsigned int Ahead; //most layers prepared above the lowest one still in use
+
+	std::mutex Mutex;
+	std::condition_variable Changed;
+	std::unordered_map<unsigned int, PreparedLayer> Layers;
+	unsigned int NextLayer = 0;
+	unsigned int FirstUsed = 0; //layers below it were already built
+	bool Stopping = false;
+	std::vector<std::thread> Threads;
+
+	LayerPreparer(BuildState& state, VoxelModel& model, Vec3i offset) : State(state), Model(model)
+	{
+		Offset = offset;
+		TourNeighbours = NeedsTourNeighbours(state);
+		Ahead = PlanningThreads * LayersAheadPerThread;
+		for (unsigned int i = 0; i < PlanningThreads; i++)
+			Threads.emplace_back([this]() { Prepare(); });
+	}
+
+	~LayerPreparer()
+	{
+		{
+			std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(Mutex);
+			Stopping = true;
+		}
+
+		Changed.notify_all();
+		for (std::thread& thread : Threads)
+			thread.join();
+	}
+
+	void Prepare()
+	{
+		std::vector<unsigned char> buffer;
+		std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(Mutex);
+		while (true)
+		{
+			Changed.wait(lock, [&]() { return Stopping || NextLayer >= Model.Height || NextLayer < FirstUsed + Ahead; });
+			if (Stopping || NextLayer >= Model.Height)
+				return;
+
+			unsigned int z = NextLayer++;
+			lock.unlock();
+			PreparedLayer prepared = PrepareLayer(State, Model, Offset, z, TourNeighbours, buffer);
+			lock.lock();
+			Layers[z] = std::move(prepared);
+			Changed.notify_all();
+		}
+	}
+
+	//waits until the layer is prepared, returned islands stay valid until the layer is released
+	const LayerIslands& Get(unsigned int z, unsigned int layers)
+	{
+		std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(Mutex);
+		Changed.wait(lock, [&]() { return Layers.contains(z); });
+		PreparedLayer& prepared = Layers[z];
+		return layers == 1 ? prepared.Single : prepared.Pair;
+	}
+
+	//layers below 'z' won't be needed anymore
+	void Release(unsigned int z)
+	{
+		{
+			std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(Mutex);
+			FirstUsed = z;
+			std::erase_if(Layers, [&](auto& layer) { return layer.first < z; });
+		}
+
+		Changed.notify_all();
+	}
+};
+
+//islands of the layer 'z' (or of layers 'z' and 'z + 1' combined), when planning on a single thread they're found right away and stored in 'found'
+const LayerIslands& GetLayerIslands(BuildState& state, VoxelModel& model, Vec3i offset, unsigned int z, unsigned int layers, LayerIslands& found)
+{
+	if (state.Preparer)
+		return state.Preparer->Get(z, layers);
+
+	found = FindLayerIslands(state, model, offset, z, layers, NeedsTourNeighbours(state), state.Layer);
+	state.BufferedLayer = NoLayer; //layer buffer was used for the copies
+	return found;
+}
+
+void BuildIsland(
+	Turtle& turtle,
+	BuildState& state,
+	VoxelModel& model,
+	const std::vector<Vec3i>& island,
+	unsigned char variant,
+	Vec3i offset,
+	unsigned int z)
+{
+	const unsigned char* layer = GetLayer(state, model, z);
+	VisitIsland(island, variant, [&](Vec3i range, bool left2right) //if 'left2right' is set turtle will build the range from start to end, vice versa otherwise
+	{
+		//turtle moves along the row facing either way, arriving already turned along it saves a turn
+		RotationRequest rowRotation = range.X == range.Z ? RotationRequest::Any : RotationRequest::EastOrWest;
+		turtle.MoveToGlobal(Vec3i(left2right ? range.X : range.Z, range.Y, turtle.Pos.Z), false, rowRotation);
+		if (ScheduleRefills)
+			RefillPoint(turtle, state, model);
+
+		for (int i = 0; i < range.Z - range.X + 1; i++)
+		{
+			int y = model.Length - turtle.Pos.Y + offset.Y - 1;
+			unsigned char mat = layer[y * model.Width + turtle.Pos.X - offset.X];
+			turtle.SelectSlot(UseMaterial(turtle, state, model, mat) + 1); //slots range from 1 to 16 (inv size) thus we need to add 1
+			turtle.Place(PlaceDigDirection::Below);
+
+			if (i != range.Z - range.X)
+				turtle.MoveByGlobal(Vec3i(left2right ? 1 : -1, 0, 0));
+		}
+	});
+}
+
+void BuildLayer(
+	Turtle& turtle,
+	BuildState& state,
+	VoxelModel& model,
+	Vec3i offset,
+	unsigned int z)
+{
+	if (model.CanSkipLayer(z))
+		return;
+
+	LayerIslands found;
+	const LayerIslands& layer = GetLayerIslands(state, model, offset, z, 1, found);
+	std::vector<TourStop> tour = GetTour(state, layer, turtle.Pos);
+	for (TourStop stop : tour)
+		BuildIsland(turtle, state, model, layer.Islands[stop.Island], stop.Variant, offset, z);
+}
+
+//builds two layers at once, turtle flies at the upper layer's height and goes through each range backwards (facing the direction it came from)
+//lower layer is placed below the turtle and the upper one in front of it (where it just was), the last block of a range is placed from above
+//upper layer's blocks are in the way so turtle travels between ranges one block higher
+void BuildIslandPair(
+	Turtle& turtle,
+	BuildState& state,
+	VoxelModel& model,
+	const std::vector<Vec3i>& island,
+	unsigned char variant,
+	const unsigned char* lower,
+	const unsigned char* upper,
+	Vec3i offset)
+{
+	VisitIsland(island, variant, [&](Vec3i range, bool left2right)
+	{
+		int step = left2right ? 1 : -1;
+		RotationRequest rowRotation = range.X == range.Z ? RotationRequest::Any : left2right ? RotationRequest::West : RotationRequest::East;
+		turtle.MoveToGlobal(Vec3i(left2right ? range.X : range.Z, range.Y, state.TravelHeight), false, rowRotation);
+		if (ScheduleRefills)
+			RefillPoint(turtle, state, model);
+		turtle.MoveByGlobal(Vec3i(0, 0, -1));
+
+		int y = model.Length - range.Y + offset.Y - 1;
+		for (int i = 0; i < range.Z - range.X + 1; i++)
+		{
+			size_t index = static_cast<size_t>(y) * model.Width + turtle.Pos.X - offset.X;
+			if (lower[index])
+			{
+				turtle.SelectSlot(UseMaterial(turtle, state, model, lower[index]) + 1);
+				turtle.Place(PlaceDigDirection::Below);
+			}
+
+			bool last = i == range.Z - range.X;
+			if (last)
+			{
+				turtle.MoveByGlobal(Vec3i(0, 0, 1));
+			}
+			else
+			{
+				turtle.SetRotation(left2right ? RotationRequest::West : RotationRequest::East);
+				turtle.MoveByGlobal(Vec3i(step, 0, 0));
+			}
+
+			if (upper[index])
+			{
+				turtle.SelectSlot(UseMaterial(turtle, state, model, upper[index]) + 1);
+				turtle.Place(last ? PlaceDigDirection::Below : PlaceDigDirection::Straight);
+			}
+		}
+	});
+}
+
+//builds layers 'z' and 'z + 1' in a single pass if it takes less moves than building them separately, otherwise builds only layer 'z'
+//returns the amount of built layers
+unsigned int BuildLayerPair(
+	Turtle& turtle,
+	BuildState& state,
+	VoxelModel& model,
+	Vec3i offset,
+	unsigned int z)
+{
+	if (model.CanSkipLayer(z) || model.CanSkipLayer(z + 1))
+	{
+		turtle.MoveByGlobal(Vec3i(0, 0, 1));
+		BuildLayer(turtle, state, model, offset, z);
+		return 1;
+	}
+
+	LayerIslands foundLower, foundUpper, found;
+	const LayerIslands& lowerLayer = GetLayerIslands(state, model, offset, z, 1, foundLower);
+	const LayerIslands& upperLayer = GetLayerIslands(state, model, offset, z + 1, 1, foundUpper);
+	const LayerIslands& pairLayer = GetLayerIslands(state, model, offset, z, 2, found);
+	std::vector<TourStop> lowerTour = GetTour(state, lowerLayer, turtle.Pos);
+	std::vector<TourStop> upperTour = GetTour(state, upperLayer, turtle.Pos);
+	std::vector<TourStop> tour = GetTour(state, pairLayer, turtle.Pos);
+
+	//each range of a pair costs an extra move down and up
+	size_t ranges = 0;
+	for (const std::vector<Vec3i>& island : pairLayer.Islands)
+		ranges += island.size();
+
+	//estimated amount of horizontal moves needed to build the islands in the tours' order
+	unsigned long long separateMoves = GetTourLength(lowerLayer.Graph.Ends, lowerTour, turtle.Pos) + GetTourLength(upperLayer.Graph.Ends, upperTour, turtle.Pos) + 1;
+	unsigned long long pairMoves = GetTourLength(pairLayer.Graph.Ends, tour, turtle.Pos) + ranges * 2 + 2;
+	if (pairMoves >= separateMoves)
+	{
+		turtle.MoveByGlobal(Vec3i(0, 0, 1));
+		for (TourStop stop : lowerTour)
+			BuildIsland(turtle, state, model, lowerLayer.Islands[stop.Island], stop.Variant, offset, z);
+		return 1;
+	}
+
+	//layer returned by 'GetLayer' may be overwritten by the next call
+	const unsigned char* layer = GetLayer(state, model, z);
+	std::vector<unsigned char> lower = std::vector<unsigned char>(layer, layer + model.GetLayerSize());
+	const unsigned char* upper = GetLayer(state, model, z + 1);
+
+	turtle.MoveByGlobal(Vec3i(0, 0, 2));
+	state.TravelHeight = turtle.Pos.Z;
+	for (TourStop stop : tour)
+		BuildIslandPair(turtle, state, model, pairLayer.Islands[stop.Island], stop.Variant, lower.data(), upper, offset);
+	return 2;
+}
+
+void PlanBuild(
+	Turtle& turtle,
+	BuildState& state,
+	VoxelModel& model,
+	Vec3i offset)
+{
+	if (ScheduleRefills)
+		RefillPoint(turtle, state, model);
+	else
+		RefillTurtle(turtle, state, model);
+
+	std::unique_ptr<LayerPreparer> preparer;
+	if (PlanningThreads > 1)
+	{
+		preparer = std::make_unique<LayerPreparer>(state, model, offset);
+		state.Preparer = preparer.get();
+	}
+
+	turtle.MoveToGlobal(Vec3i(state.Start.X, state.Start.Y, offset.Z));
+	for (unsigned int z = 0; z < model.Height;)
+	{
+		unsigned int layers = 1;
+		if (MultiLayer && z + 1 < model.Height)
+		{
+			layers = BuildLayerPair(turtle, state, model, offset, z);
+		}
+		else
+		{
+			turtle.MoveByGlobal(Vec3i(0, 0, 1));
+			BuildLayer(turtle, state, model, offset, z);
+		}
+
+		//when streaming only instructions since the last refill and the current layer's voxels are kept in memory
+		//refill block is still waiting for the final amounts, instructions are optimized up to it and flushed once later ones can't change them
+		if (turtle.OutputFile.is_open())
+		{
+			turtle.Flush(turtle.Optimize(&state.RefillBlockBeginning));
+			for (unsigned int l = z; l < z + layers; l++)
+				model.ReleaseLayer(l);
+		}
+
+		z += layers;
+		if (preparer)
+			preparer->Release(z);
+	}
+
+	state.Preparer = nullptr;
+	WriteRefillBlock(turtle, state); //last refill
+	turtle.MoveToGlobal(state.Start, false, RotationRequest::North);
+	turtle.FinishRefuel();
+	turtle.Optimize();
+}
+
+void BuildModel(
+	Turtle& turtle,
+	BuildState& state,
+	VoxelModel& model,
+	Vec3i offset)
+{
+	if (ScheduleRefills)
+	{
+		//dry run with a turtle which doesn't write any instructions and a copy of the state
+		Turtle dryTurtle;
+		dryTurtle.Pos = dryTurtle.MinPos = dryTurtle.MaxPos = turtle.Pos;
+		dryTurtle.Rotation = turtle.Rotation;
+		dryTurtle.Costs = turtle.Costs;
+		dryTurtle.FuelLevel = turtle.FuelLevel;
+		dryTurtle.WriteInstructions = false;
+
+		RefillScheduler scheduler = RefillScheduler(MaxRefuelStacks * StackSize * turtle.FuelPerItem, turtle.FuelLimit, turtle.FuelLevel);
+		BuildState dryState = state;
+		dryState.Scheduler = &scheduler;
+		PlanBuild(dryTurtle, dryState, model, offset);
+
+		state.RefillSchedule = scheduler.GetSchedule(dryTurtle.Moves);
+		state.Tours = std::move(dryState.Tours);
+	}
+
+	PlanBuild(turtle, state, model, offset);
+}
+
+std::vector<unsigned int> GetStripes(VoxelModel& model, unsigned int turtleCount)
+{
+	std::vector<unsigned long long> columns = std::vector<unsigned long long>(model.Width + 1); //voxel count changes (prefix sums give voxel count per column)
+	std::vector<Run> runs;
+	unsigned long long total = 0;
+	for (unsigned int z = 0; z < model.Height; z++)
+	{
+		if (model.CanSkipLayer(z))
+			continue;
+
+		const unsigned char* layer = model.GetLayer(z);
+		for (unsigned int y = 0; y < model.Length; y++)
+		{
+			runs.clear();
+			FindRuns(layer + static_cast<size_t>(model.Width) * y, model.Width, runs);
+			for (Run run : runs)
+			{
+				columns[run.Start]++;
+				columns[run.End + 1]--;
+			}
+		}
+
+		model.ReleaseLayer(z);
+	}
+
+	unsigned long long count = 0;
+	for (unsigned int x = 0; x < model.Width; x++)
+	{
+		count += columns[x];
+		columns[x] = count;
+		total += count;
+	}
+
+	std::vector<unsigned int> stripes = { 0 };
+	unsigned long long voxels = 0;
+	for (unsigned int x = 0; x < model.Width && stripes.size() < turtleCount; x++)
+	{
+		voxels += columns[x];
+		if (voxels * turtleCount >= total * stripes.size())
+			stripes.push_back(x + 1);
+	}
+
+	if (stripes.back() != model.Width)
+		stripes.push_back(model.Width);
+	return stripes;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include "turtle.hpp"
+#include "voxel.hpp"
+#include "tour.hpp"
+#include "refills.hpp"
+
+extern unsigned int TourBudget; //time in milliseconds spent improving the order in which islands of each layer are built
+extern bool MultiLayer; //build two layers in a single pass when it takes less moves than building them one by one
+extern bool ScheduleRefills; //plan the build twice, the first time to choose the refill moments, instead of refilling only once the inventory is full
+//output is the same for any count unless a tour is cut off by 'TourBudget' before it stops improving (how far it gets depends on how busy the cores are)
+extern unsigned int PlanningThreads; //threads preparing islands of the upcoming layers while the turtle's path is planned
+
+const unsigned int RefillBlockSize = 2 + InventorySize * 3; //request batch instruction with its length and 3 bytes per request, for each inventory slot
+const unsigned char NoSlot = 0xFF;
+
+//islands of a layer (or of two layers built in a single pass) and their tour graph, neither depends on the turtle
+struct LayerIslands
+{
+	std::vector<std::vector<Vec3i>> Islands;
+	TourGraph Graph;
+};
+
+//islands of the layer 'z' and of the layers 'z' and 'z + 1' combined (when they may be built in a single pass)
+struct PreparedLayer
+{
+	LayerIslands Single;
+	LayerIslands Pair;
+};
+
+struct LayerPreparer;
+
+//everything needed to plan a single turtle's part of the build, turtles are planned in parallel so they don't share any of it
+struct BuildState
+{
+	//to determine the required amount of materials we reserve this block of memory before writing building instructions and incrementing
+	//item count for materials, then when inventory gets fully used we go back to this block and fill it with request instructions
+	//for now known material amounts
+	unsigned int RefillCount = 0;
+	size_t RefillBlockBeginning = 0;
+	unsigned int SlotsUsed = 0;
+	unsigned char ItemCount[InventorySize] = {};
+	unsigned char Materials[InventorySize] = {}; //material ID by slot
+	unsigned char CurrentSlot[MaxMaterials] = {}; //current slot used by the material, 'NoSlot' if it has none (or its stack is used up)
+
+	int TravelHeight = std::numeric_limits<int>().min(); //turtle has to climb to this height before traveling, blocks below it may be in the way
+	std::vector<Vec3i> Refills; //global positions where turtle can request additional fuel and materials
+	Vec3i Start = Vec3i(0); //turtle's starting position, it returns there when done
+
+	//columns of the model built by the turtle (from 'MinX' up to, not including, 'MaxX')
+	unsigned int MinX = 0;
+	unsigned int MaxX = 0;
+
+	//refill scheduling, during the dry run 'Scheduler' is set and collects refill points and tours (reused so that both runs build the same way)
+	//then the real run refills at the points listed in 'RefillSchedule'
+	RefillScheduler* Scheduler = nullptr;
+	std::vector<unsigned int> RefillSchedule;
+	size_t NextRefill = 0;
+	unsigned int RefillPoints = 0;
+	std::vector<std::vector<TourStop>> Tours;
+	size_t NextTour = 0;
+
+	LayerPreparer* Preparer = nullptr; //set while planning with more than one planning thread
+
+	//turtle's own copy of the current layer for models which don't store layers contiguously
+	std::vector<unsigned char> Layer;
+	unsigned int BufferedLayer = NoLayer;
+};
+
+//returns the layer 'z', models which don't store layers contiguously copy it to the state's buffer (valid until the next call)
+const unsigned char* GetLayer(BuildState& state, VoxelModel& model, unsigned int z);
+
+//islands are 4-connected groups of ranges, their ranges are ordered by row (top to bottom) and X
+//'layer' is the layer 'z' or a combination of 'layers' layers starting from 'z' (non-empty where any of them is non-empty)
+std::vector<std::vector<Vec3i>> GetIslands(BuildState& state, VoxelModel& model, const unsigned char* layer, Vec3i offset, unsigned int z, unsigned int layers = 1);
+
+//islands of the layer 'z' and the next one, 'buffer' is used for layers which have to be copied (so it can be called from any thread)
+PreparedLayer PrepareLayer(BuildState& state, VoxelModel& model, Vec3i offset, unsigned int z, bool tourNeighbours, std::vector<unsigned char>& buffer);
+
+//'offset' is model's global position
+//turtle requests additional fuel and materials at the state's refill positions, turtle controller must be running to handle their requests
+void BuildModel(Turtle& turtle, BuildState& state, VoxelModel& model, Vec3i offset);
+
+//splits the model into stripes of columns (along X) containing about the same amount of voxels, one for each turtle
+//turtles never leave their stripes (as long as their starting and refill positions are in front of them) so they can't run into each other
+//returns stripe boundaries, stripe 'i' is [stripes[i], stripes[i + 1])
+std::vector<unsigned int> GetStripes(VoxelModel& model, unsigned int turtleCount);
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <string>
 #include "turtle.hpp"
 
@@ -26,9 +27,7 @@ void Refill(Turtle& turtle, std::vector<Vec3i>& refills)
 		turtle.Unload(StackSize);
 	}
 
-	turtle.Request(1, StackSize);
-	turtle.Refuel(StackSize);
-	turtle.Unload(StackSize);
+	turtle.ReserveRefuel(1); //fuel needed to get to the next refill is known once the turtle gets there
 
 	turtle.MoveToGlobal(oldPos);
 	turtle.SelectedSlot = 0;
@@ -74,6 +73,7 @@ unsigned int DigQuarry(Turtle& turtle, std::vector<Vec3i>& refills, Vec3i dims,
 	}
 
 	turtle.MoveToGlobal(Vec3i(0), true);
+	turtle.FinishRefuel();
 	return refillCount;
 }
 
@@ -111,6 +111,16 @@ int main()
 		refills.push_back(Vec3i::FromString(str));
 	}
 
+	std::cout << "Fuel value of one fuel item (e.g. 80 for coal): ";
+	std::cin >> turtle.FuelPerItem;
+
+	std::cout << "Turtle's fuel limit (20000 for turtles, 100000 for advanced turtles): ";
+	std::cin >> turtle.FuelLimit;
+
+	std::cout << "Turtle's fuel level at the start: ";
+	std::cin >> turtle.FuelLevel;
+	turtle.FuelLevel = std::min<long long>(turtle.FuelLevel, turtle.FuelLimit);
+
 	std::cout << "Digging quarry...\n";
 	unsigned int refillCount = DigQuarry(turtle, refills, dims, start, bpr, down);
 
@@ -118,6 +128,7 @@ int main()
 	std::cin >> str;
 
 	std::vector<std::string> mats = { str };
+	turtle.Optimize();
 	turtle.WriteToFile("quarry-output.bin", mats);
 	std::cout << turtle.Instructions.size() << " bytes, " << refillCount << " refills.\nOutput written to 'quarry-output.bin'. Press any key to exit.";
 	std::cin.ignore();
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <limits>
+#include "refills.hpp"
+
+//slots needed to hold the items, each material takes as many slots as it needs stacks
+static unsigned int GetSlotCount(const unsigned int* items)
+{
+	unsigned int slots = 0;
+	for (unsigned int i = 0; i < MaxMaterials; i++)
+		slots += (items[i] + StackSize - 1) / StackSize;
+	return slots;
+}
+
+RefillScheduler::RefillScheduler(unsigned int fuelGain, unsigned int fuelLimit, long long startFuel)
+{
+	FuelGain = fuelGain;
+	FuelLimit = fuelLimit;
+	StartFuel = startFuel;
+}
+
+bool RefillScheduler::UseItem(unsigned char mat)
+{
+	if (Window.empty())
+		return false;
+
+	//the first refill in the window is the oldest one, so its inventory gets full first
+	WindowItems[mat]++;
+	if (GetSlotCount(WindowItems) > InventorySize)
+	{
+		WindowItems[mat]--;
+		Pending = mat;
+		return true;
+	}
+
+	Window.back().Items[mat]++;
+	return false;
+}
+
+void RefillScheduler::AddRefill(unsigned long long moves, unsigned int distance, unsigned long long cost, bool forced)
+{
+	Refill refill = { static_cast<unsigned int>(Previous.size()), 0 };
+	Moves.push_back(moves);
+	Distances.push_back(distance);
+	Points.push_back(forced ? NoRefillPoint : PointCount++);
+	if (Previous.empty())
+	{
+		Previous.push_back(0);
+		Window.push_back(refill);
+		return;
+	}
+
+	//refills which have no room for the pending item are forced to refill here, the cheapest one of them is the preceding one
+	//other refills are followed by the cheapest one which is still in the window
+	Refill best = {};
+	best.Cost = std::numeric_limits<unsigned long long>::max();
+	if (Pending >= 0)
+		WindowItems[Pending]++;
+
+	while (!Window.empty() && GetSlotCount(WindowItems) > InventorySize)
+	{
+		if (Window.front().Cost < best.Cost)
+			best = Window.front();
+		for (unsigned int i = 0; i < MaxMaterials; i++)
+			WindowItems[i] -= Window.front().Items[i];
+		Window.pop_front();
+	}
+
+	if (Pending >= 0)
+		WindowItems[Pending]--;
+	Pending = -1;
+
+	if (!forced)
+	{
+		best.Cost = std::numeric_limits<unsigned long long>::max();
+		for (const Refill& r : Window)
+		{
+			if (r.Cost < best.Cost)
+				best = r;
+		}
+	}
+
+	refill.Cost = best.Cost + cost;
+	Previous.push_back(best.Index);
+	Window.push_back(refill);
+}
+
+std::vector<unsigned int> RefillScheduler::GetSchedule(unsigned long long moves)
+{
+	//end of the build is a refill point without any cost, the turtle isn't refilled there
+	AddRefill(moves, 0, 0, false);
+
+	std::vector<unsigned int> refills;
+	for (unsigned int i = Previous.back(); ; i = Previous[i])
+	{
+		refills.push_back(i);
+		if (i == 0)
+			break;
+	}
+	std::reverse(refills.begin(), refills.end());
+
+	//fuel carries over between refills so it's checked for the whole schedule, when the turtle would run out of it before the next refill
+	//another one is added at the last refill point from which it can still reach a refill position
+	std::vector<unsigned int> schedule;
+	long long fuel = StartFuel;
+	unsigned int end = Previous.size() - 1;
+	for (size_t r = 0; r < refills.size(); r++)
+	{
+		unsigned int refill = refills[r];
+		unsigned int next = r + 1 < refills.size() ? refills[r + 1] : end;
+		while (true)
+		{
+			if (Points[refill] != NoRefillPoint)
+				schedule.push_back(Points[refill]);
+			fuel = std::min<long long>(fuel - Distances[refill] + FuelGain, FuelLimit) - Distances[refill];
+
+			//fuel needed to get from this refill to the refill position of refill 'i'
+			auto needed = [&](unsigned int i) { return static_cast<long long>(Moves[i] - Moves[refill] + Distances[i]); };
+			if (needed(next) <= fuel)
+				break;
+
+			unsigned int reachable = refill;
+			for (unsigned int i = refill + 1; i < next && needed(i) <= fuel; i++)
+			{
+				if (Points[i] != NoRefillPoint)
+					reachable = i;
+			}
+
+			if (reachable == refill)
+				break;
+
+			fuel -= Moves[reachable] - Moves[refill];
+			refill = reachable;
+		}
+
+		fuel -= Moves[next] - Moves[refill];
+	}
+
+	return schedule;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <deque>
+#include <vector>
+#include "turtle.hpp"
+
+const unsigned int NoRefillPoint = 0xFFFFFFFF;
+
+//chooses refill moments which minimize the time spent traveling to refill positions
+//build is planned twice, during the first (dry) run turtle reports each point at which it could refill and items it uses between them
+//schedule then tells the second run at which of those points the turtle should refill, so that it never runs out of free slots or fuel in between
+//turtle still refills on its own when it has no free slot for a material, the schedule takes those refills into account as well
+struct RefillScheduler
+{
+	//refill at a refill point or a forced one (inventory got full)
+	struct Refill
+	{
+		unsigned int Index;
+		unsigned long long Cost; //lowest cost of all refills up to and including this one
+		unsigned int Items[MaxMaterials] = {}; //items used after this refill, up to the next one
+	};
+
+	unsigned int FuelGain; //most fuel gained at a refill
+	unsigned int FuelLimit;
+	long long StartFuel; //fuel level at the start
+	int Pending = -1; //material of the item which didn't fit into the inventory, it's used right after the forced refill
+
+	//refills which may still be followed by another one without running out of slots, 'WindowItems' are items used since the first one
+	std::deque<Refill> Window;
+	unsigned int WindowItems[MaxMaterials] = {};
+
+	//for each refill: the preceding one in the cheapest schedule ending with it, moves made before it, moves to the refill position
+	//and its refill point (or 'NoRefillPoint' for forced refills)
+	std::vector<unsigned int> Previous;
+	std::vector<unsigned long long> Moves;
+	std::vector<unsigned int> Distances;
+	std::vector<unsigned int> Points;
+	unsigned int PointCount = 0;
+
+	RefillScheduler(unsigned int fuelGain, unsigned int fuelLimit, long long startFuel);
+
+	bool UseItem(unsigned char mat); //'mat' starts from 0, returns true if the item doesn't fit, it has to be used again after the forced refill
+	void AddRefill(unsigned long long moves, unsigned int distance, unsigned long long cost, bool forced); //first refill is the initial one
+	std::vector<unsigned int> GetSchedule(unsigned long long moves); //returns refill points at which turtle refills, in ascending order
+};
@@ -0,0 +1,116 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "runs.hpp"
+
+const unsigned int LayerWidth = 4096;
+const unsigned int LayerLength = 1024;
+const unsigned int Repeats = 20;
+
+//'fill' is the chance of a voxel being solid, 'runLength' is the average length of solid/empty spans
+std::vector<unsigned char> GenerateLayer(double fill, double runLength, unsigned int seed)
+{
+    std::mt19937 random = std::mt19937(seed);
+    std::uniform_real_distribution<double> chance = std::uniform_real_distribution<double>(0.0, 1.0);
+    std::vector<unsigned char> layer = std::vector<unsigned char>(static_cast<size_t>(LayerWidth) * LayerLength);
+
+    bool solid = false;
+    for (unsigned char& voxel : layer)
+    {
+        if (chance(random) < 1.0 / runLength)
+            solid = chance(random) < fill;
+        voxel = solid ? 1 + random() % 4 : 0;
+    }
+
+    return layer;
+}
+
+//returns time per layer in microseconds
+double Measure(RunFinderFn finder, std::vector<unsigned char>& layer, std::vector<Run>& runs)
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < Repeats; i++)
+    {
+        runs.clear();
+        for (unsigned int y = 0; y < LayerLength; y++)
+            finder(layer.data() + static_cast<size_t>(y) * LayerWidth, LayerWidth, runs);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::micro>(end - begin).count() / Repeats;
+}
+
+bool SameRuns(std::vector<Run>& a, std::vector<Run>& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].Start != b[i].Start || a[i].End != b[i].End)
+            return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    std::cout << "== runbench ==\n";
+    std::cout << "Layer: " << LayerWidth << " x " << LayerLength << ", selected implementation: " << GetRunFinderName() << "\n";
+
+    struct LayerType
+    {
+        const char* Name;
+        double Fill;
+        double RunLength;
+    };
+
+    LayerType types[] =
+    {
+        { "dense", 0.95, 200.0 },
+        { "sparse", 0.05, 50.0 },
+        { "pixel art", 0.5, 4.0 },
+        { "noise", 0.5, 1.0 }
+    };
+
+    struct Implementation
+    {
+        const char* Name;
+        RunFinderFn Function;
+    };
+
+    Implementation implementations[] =
+    {
+        { "scalar", FindRunsScalar },
+        { "SSE2", FindRunsSSE2 },
+        { "AVX2", FindRunsAVX2 }
+    };
+
+    bool avx2 = std::string(GetRunFinderName()) == "AVX2";
+    for (LayerType& type : types)
+    {
+        std::vector<unsigned char> layer = GenerateLayer(type.Fill, type.RunLength, 1);
+        std::vector<Run> reference;
+        double scalarTime = Measure(FindRunsScalar, layer, reference);
+
+        std::cout << type.Name << " (" << reference.size() << " runs):\n";
+        for (Implementation& implementation : implementations)
+        {
+            if (implementation.Function == FindRunsAVX2 && !avx2)
+            {
+                std::cout << "  " << implementation.Name << ": not supported\n";
+                continue;
+            }
+
+            std::vector<Run> runs;
+            double time = Measure(implementation.Function, layer, runs);
+            std::cout << "  " << implementation.Name << ": " << time << " us/layer, " << scalarTime / time << "x";
+            std::cout << (SameRuns(runs, reference) ? "\n" : " (MISMATCH)\n");
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include <bit>
+#include <cstdint>
+#include <vector>
+#include "runs.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RUNS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RUNS_TARGET_AVX2
+#else
+#define RUNS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+
+//finishes the row byte by byte starting from 'x', 'inRun' and 'start' describe the run which is in progress
+static void FindRunsTail(const unsigned char* row, unsigned int x, unsigned int width, bool inRun, unsigned int start, std::vector<Run>& runs)
+{
+    for (; x < width; x++)
+    {
+        if (!inRun && row[x])
+        {
+            start = x;
+            inRun = true;
+        }
+        else if (inRun && !row[x])
+        {
+            runs.push_back({ start, x - 1 });
+            inRun = false;
+        }
+    }
+
+    if (inRun)
+        runs.push_back({ start, width - 1 });
+}
+
+//'filled' has a bit set for each non-zero byte of a block beginning at 'x', bits where the state changes are run edges
+template <typename Mask>
+static inline void AddEdges(Mask filled, unsigned int x, bool& inRun, unsigned int& start, std::vector<Run>& runs)
+{
+    Mask edges = filled ^ ((filled << 1) | static_cast<Mask>(inRun));
+    while (edges)
+    {
+        unsigned int bit = std::countr_zero(edges);
+        if (inRun)
+            runs.push_back({ start, x + bit - 1 });
+        else
+            start = x + bit;
+
+        inRun = !inRun;
+        edges &= edges - 1;
+    }
+}
+
+void FindRunsScalar(const unsigned char* row, unsigned int width, std::vector<Run>& runs)
+{
+    FindRunsTail(row, 0, width, false, 0, runs);
+}
+
+#ifdef RUNS_X86
+
+//32 bytes per iteration, SSE2 is always available on x86-64
+void FindRunsSSE2(const unsigned char* row, unsigned int width, std::vector<Run>& runs)
+{
+    const __m128i zero = _mm_setzero_si128();
+    bool inRun = false;
+    unsigned int start = 0;
+    unsigned int x = 0;
+
+    for (; x + 32 <= width; x += 32)
+    {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 16));
+        uint32_t empty =
+            static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, zero))) |
+            static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero))) << 16;
+        AddEdges<uint32_t>(~empty, x, inRun, start, runs);
+    }
+
+    FindRunsTail(row, x, width, inRun, start, runs);
+}
+
+//64 bytes per iteration
+RUNS_TARGET_AVX2 void FindRunsAVX2(const unsigned char* row, unsigned int width, std::vector<Run>& runs)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    bool inRun = false;
+    unsigned int start = 0;
+    unsigned int x = 0;
+
+    for (; x + 64 <= width; x += 64)
+    {
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x + 32));
+        uint64_t empty =
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, zero)))) |
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, zero)))) << 32;
+        AddEdges<uint64_t>(~empty, x, inRun, start, runs);
+    }
+
+    FindRunsTail(row, x, width, inRun, start, runs);
+}
+
+static bool IsAVX2Supported()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx = info[2] & (1 << 28);
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) //OS must save YMM registers
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#else
+
+void FindRunsSSE2(const unsigned char* row, unsigned int width, std::vector<Run>& runs)
+{
+    FindRunsScalar(row, width, runs);
+}
+
+void FindRunsAVX2(const unsigned char* row, unsigned int width, std::vector<Run>& runs)
+{
+    FindRunsScalar(row, width, runs);
+}
+
+#endif
+
+struct RunFinderInfo
+{
+    RunFinderFn Function;
+    const char* Name;
+};
+
+static RunFinderInfo SelectRunFinder()
+{
+#ifdef RUNS_X86
+    if (IsAVX2Supported())
+        return { FindRunsAVX2, "AVX2" };
+    return { FindRunsSSE2, "SSE2" };
+#else
+    return { FindRunsScalar, "scalar" };
+#endif
+}
+
+static RunFinderInfo& GetRunFinder()
+{
+    static RunFinderInfo finder = SelectRunFinder();
+    return finder;
+}
+
+void FindRuns(const unsigned char* row, unsigned int width, std::vector<Run>& runs)
+{
+    GetRunFinder().Function(row, width, runs);
+}
+
+const char* GetRunFinderName()
+{
+    return GetRunFinder().Name;
+}
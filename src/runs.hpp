@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+
+//span of non-zero bytes, both ends are inclusive
+struct Run
+{
+    unsigned int Start;
+    unsigned int End;
+};
+
+typedef void (*RunFinderFn)(const unsigned char* row, unsigned int width, std::vector<Run>& runs);
+
+//appends runs of non-zero bytes found in 'row' to 'runs' (in ascending order)
+//uses the widest vector instructions supported by the cpu, selected on the first call
+void FindRuns(const unsigned char* row, unsigned int width, std::vector<Run>& runs);
+
+//separate implementations, used by the benchmark, SIMD ones fall back to the scalar one if they aren't compiled in
+void FindRunsScalar(const unsigned char* row, unsigned int width, std::vector<Run>& runs);
+void FindRunsSSE2(const unsigned char* row, unsigned int width, std::vector<Run>& runs);
+void FindRunsAVX2(const unsigned char* row, unsigned int width, std::vector<Run>& runs);
+
+const char* GetRunFinderName(); //name of the implementation used by 'FindRuns'
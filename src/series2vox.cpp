@@ -3,6 +3,8 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <vector>
+#include <algorithm>
 #include "stb_image.h"
 #include "voxel.hpp"
 
@@ -14,16 +16,17 @@ void ProcessImage(VoxelModel& model, std::filesystem::path path, unsigned int z)
     if (model.Width != width || model.Length != height)
         throw std::runtime_error("Image sizes must be identical.");
 
-    unsigned char* layer = model.GetLayer(z);
+    std::vector<unsigned char> layer = std::vector<unsigned char>(model.GetLayerSize());
     for (int y = 0; y < model.Length; y++)
     {
         for (int x = 0; x < model.Width; x++)
         {
             int index = y * model.Width + x;
-            layer[index] = data[index * channels + 3] > 0;
+            layer[index] = data[index * 4 + 3] > 0; //image is always loaded with 4 channels
         }
     }
 
+    model.SetLayer(z, layer.data());
     delete[] data;
 }
 
@@ -42,6 +45,11 @@ int main()
         return -1;
     }
 
+    char compress;
+    std::cout << "Compress output? (Y/N) ";
+    std::cin >> compress;
+    compress = compress == 'y' || compress == 'Y';
+
     std::vector<std::filesystem::path> images;
     for (auto& entry : std::filesystem::directory_iterator(path))
     {
@@ -54,13 +62,13 @@ int main()
 
     int width, height, channels;
     stbi_info(images.front().string().c_str(), &width, &height, &channels);
-    VoxelModel model = VoxelModel(width, height, images.size(), 1, new unsigned char [width * height * images.size()]);
+    VoxelModel model = VoxelModel(width, height, images.size(), 1, VoxelStorage::Bricked); //bricked so empty space around the model isn't stored
     std::sort(images.begin(), images.end(), [](std::filesystem::path a, std::filesystem::path b) { return a.string() < b.string(); });
     for (int z = 0; z < images.size(); z++)
     {
         ProcessImage(model, images[z], z);
     }
-    model.WriteToFile("series2vox-output.vox");
+    model.WriteToFile("series2vox-output.vox", compress);
 
     return 0;
 }
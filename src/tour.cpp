@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "tour.hpp"
+
+const unsigned int NeighbourCount = 8; //candidate islands considered for each tour move
+const unsigned int MaxSegmentLength = 3; //longest segment moved by or-opt
+
+static unsigned int GetDistance(Vec3i a, Vec3i b)
+{
+	return abs(a.X - b.X) + abs(a.Y - b.Y);
+}
+
+//uniform grid over points, finds the nearest ones without checking all of them
+struct PointGrid
+{
+	int MinX;
+	int MinY;
+	int CellSize;
+	int Columns;
+	int Rows;
+	std::vector<Vec3i> Points;
+	std::vector<std::vector<unsigned int>> Cells;
+
+	PointGrid(std::vector<Vec3i> points)
+	{
+		Points = points;
+		MinX = MinY = std::numeric_limits<int>().max();
+		int maxX = std::numeric_limits<int>().min();
+		int maxY = std::numeric_limits<int>().min();
+		for (Vec3i point : points)
+		{
+			MinX = std::min(MinX, point.X);
+			MinY = std::min(MinY, point.Y);
+			maxX = std::max(maxX, point.X);
+			maxY = std::max(maxY, point.Y);
+		}
+
+		//about two points per cell
+		double area = (static_cast<double>(maxX) - MinX + 1) * (static_cast<double>(maxY) - MinY + 1);
+		CellSize = std::max(1, static_cast<int>(std::sqrt(area * 2 / std::max<size_t>(points.size(), 1))));
+		Columns = (maxX - MinX) / CellSize + 1;
+		Rows = (maxY - MinY) / CellSize + 1;
+		Cells = std::vector<std::vector<unsigned int>>(static_cast<size_t>(Columns) * Rows);
+		for (unsigned int i = 0; i < points.size(); i++)
+			Cells[GetCell(points[i])].push_back(i);
+	}
+
+	size_t GetCell(Vec3i pos)
+	{
+		int cx = pos.X < MinX ? 0 : std::min((pos.X - MinX) / CellSize, Columns - 1);
+		int cy = pos.Y < MinY ? 0 : std::min((pos.Y - MinY) / CellSize, Rows - 1);
+		return static_cast<size_t>(cy) * Columns + cx;
+	}
+
+	//calls 'visit(index, distance)' for all points in the ring of cells 'r' cells away from the position's cell
+	//points in ring r + 1 are at least r * CellSize + 1 away from the position
+	template <typename Visitor>
+	void VisitRing(Vec3i pos, int r, Visitor visit)
+	{
+		size_t cell = GetCell(pos);
+		int cx = cell % Columns;
+		int cy = cell / Columns;
+
+		for (int y = cy - r; y <= cy + r; y++)
+		{
+			if (y < 0 || y >= Rows)
+				continue;
+
+			int step = y == cy - r || y == cy + r ? 1 : 2 * r; //only the ring's border
+			for (int x = cx - r; x <= cx + r; x += std::max(step, 1))
+			{
+				if (x < 0 || x >= Columns)
+					continue;
+
+				for (unsigned int i : Cells[static_cast<size_t>(y) * Columns + x])
+					visit(i, GetDistance(pos, Points[i]));
+			}
+		}
+	}
+
+	//returns index of the nearest point, ties are resolved in favor of the lowest index
+	unsigned int FindNearest(Vec3i pos)
+	{
+		unsigned int nearest = std::numeric_limits<unsigned int>().max();
+		unsigned int minDist = std::numeric_limits<unsigned int>().max();
+
+		for (int r = 0; r <= std::max(Columns, Rows); r++)
+		{
+			VisitRing(pos, r, [&](unsigned int i, unsigned int dist)
+			{
+				if (dist < minDist || (dist == minDist && i < nearest))
+				{
+					minDist = dist;
+					nearest = i;
+				}
+			});
+
+			if (nearest != std::numeric_limits<unsigned int>().max() && minDist <= static_cast<unsigned int>(r * CellSize))
+				break;
+		}
+
+		return nearest;
+	}
+
+	//appends indices of (at least) 'count' nearest points to 'nearby'
+	void FindNearby(Vec3i pos, unsigned int count, std::vector<unsigned int>& nearby)
+	{
+		std::vector<std::pair<unsigned int, unsigned int>> found; //distance, index
+		for (int r = 0; r <= std::max(Columns, Rows); r++)
+		{
+			VisitRing(pos, r, [&](unsigned int i, unsigned int dist) { found.push_back({ dist, i }); });
+
+			if (found.size() >= count)
+			{
+				std::nth_element(found.begin(), found.begin() + count - 1, found.end());
+				if (found[count - 1].first <= static_cast<unsigned int>(r * CellSize))
+					break;
+			}
+		}
+
+		std::sort(found.begin(), found.end());
+		for (unsigned int i = 0; i < std::min<size_t>(count, found.size()); i++)
+			nearby.push_back(found[i].second);
+	}
+
+	void Remove(unsigned int i)
+	{
+		std::vector<unsigned int>& cell = Cells[GetCell(Points[i])];
+		cell.erase(std::find(cell.begin(), cell.end(), i));
+	}
+};
+
+IslandEnds GetIslandEnds(const std::vector<Vec3i>& island)
+{
+	IslandEnds ends;
+	for (unsigned char variant = 0; variant < TourVariants; variant++)
+	{
+		bool first = true;
+		Vec3i pos;
+		unsigned int cost = 0;
+
+		VisitIsland(island, variant, [&](Vec3i range, bool left2right)
+		{
+			Vec3i begin = Vec3i(left2right ? range.X : range.Z, range.Y, 0);
+			Vec3i end = Vec3i(left2right ? range.Z : range.X, range.Y, 0);
+			if (first)
+				ends.Entry[variant] = begin;
+			else
+				cost += GetDistance(pos, begin);
+
+			cost += range.Z - range.X;
+			pos = end;
+			first = false;
+		});
+
+		ends.Exit[variant] = pos;
+		ends.Cost[variant] = cost;
+	}
+
+	unsigned int rows = 1;
+	for (unsigned int i = 1; i < island.size(); i++)
+		rows += island[i].Y != island[i - 1].Y;
+
+	//going backwards means starting from the other end and going against the last row's direction
+	for (unsigned char variant = 0; variant < TourVariants; variant++)
+	{
+		bool left2right = !(variant & TourRightToLeft);
+		bool lastLeft2Right = rows % 2 ? left2right : !left2right;
+		ends.Reverse[variant] = ((variant & TourBottomUp) ^ TourBottomUp) | (lastLeft2Right ? TourRightToLeft : 0);
+	}
+
+	return ends;
+}
+
+unsigned long long GetTourLength(const std::vector<IslandEnds>& ends, const std::vector<TourStop>& tour, Vec3i start)
+{
+	unsigned long long length = 0;
+	Vec3i pos = start;
+	for (TourStop stop : tour)
+	{
+		const IslandEnds& island = ends[stop.Island];
+		length += GetDistance(pos, island.Entry[stop.Variant]) + island.Cost[stop.Variant];
+		pos = island.Exit[stop.Variant];
+	}
+
+	return length;
+}
+
+struct TourState
+{
+	const std::vector<IslandEnds>& Ends;
+	std::vector<TourStop>& Order;
+	std::vector<unsigned int> Positions; //position of each island in the tour
+	Vec3i Start;
+	std::chrono::steady_clock::time_point Deadline;
+	bool OutOfTime = false;
+
+	TourState(const std::vector<IslandEnds>& ends, std::vector<TourStop>& order, Vec3i start) : Ends(ends), Order(order)
+	{
+		Start = start;
+		Positions = std::vector<unsigned int>(order.size());
+		for (unsigned int i = 0; i < order.size(); i++)
+			Positions[order[i].Island] = i;
+	}
+
+	int Size()
+	{
+		return Order.size();
+	}
+
+	Vec3i GetEntry(int i)
+	{
+		return Ends[Order[i].Island].Entry[Order[i].Variant];
+	}
+
+	//exit of the island before the first one is the tour's start
+	Vec3i GetExit(int i)
+	{
+		return i < 0 ? Start : Ends[Order[i].Island].Exit[Order[i].Variant];
+	}
+
+	//distance from the exit of 'from' to the entry of 'to', tour is open so there is no link after the last island
+	long long GetLink(Vec3i from, int to)
+	{
+		return to < Size() ? GetDistance(from, GetEntry(to)) : 0;
+	}
+
+	bool CheckTime()
+	{
+		OutOfTime = OutOfTime || std::chrono::steady_clock::now() > Deadline;
+		return OutOfTime;
+	}
+
+	void Flip(int i)
+	{
+		Order[i].Variant = Ends[Order[i].Island].Reverse[Order[i].Variant];
+	}
+
+	void UpdatePositions(int first, int last)
+	{
+		for (int i = first; i <= last; i++)
+			Positions[Order[i].Island] = i;
+	}
+
+	//reverses the part of the tour between 'first' and 'last' (inclusive), islands in it are built backwards
+	void Reverse(int first, int last)
+	{
+		std::reverse(Order.begin() + first, Order.begin() + last + 1);
+		for (int i = first; i <= last; i++)
+			Flip(i);
+		UpdatePositions(first, last);
+	}
+};
+
+//picks the cheapest variant for each island given its neighbours in the tour
+static bool OptimizeVariants(TourState& tour)
+{
+	bool improved = false;
+	for (int i = 0; i < tour.Size(); i++)
+	{
+		const IslandEnds& ends = tour.Ends[tour.Order[i].Island];
+		Vec3i prev = tour.GetExit(i - 1);
+
+		unsigned char best = tour.Order[i].Variant;
+		long long bestCost = GetDistance(prev, ends.Entry[best]) + ends.Cost[best] + tour.GetLink(ends.Exit[best], i + 1);
+		for (unsigned char variant = 0; variant < TourVariants; variant++)
+		{
+			long long cost = GetDistance(prev, ends.Entry[variant]) + ends.Cost[variant] + tour.GetLink(ends.Exit[variant], i + 1);
+			if (cost < bestCost)
+			{
+				best = variant;
+				bestCost = cost;
+			}
+		}
+
+		improved = improved || best != tour.Order[i].Variant;
+		tour.Order[i].Variant = best;
+	}
+
+	return improved;
+}
+
+//reverses tour segments [i, j] when it makes the tour shorter, candidates for 'j' are the islands near i's predecessor (new link to j's exit)
+//and the islands following the ones near i (new link from i's entry to j's successor)
+static bool OptimizeTwoOpt(TourState& tour, const std::vector<std::vector<unsigned int>>& neighbours, std::vector<unsigned int>& startNeighbours)
+{
+	bool improved = false;
+	std::vector<int> ends;
+	for (int i = 0; i < tour.Size(); i++)
+	{
+		if (i % 64 == 0 && tour.CheckTime())
+			break;
+
+		ends.clear();
+		for (unsigned int candidate : i == 0 ? startNeighbours : neighbours[tour.Order[i - 1].Island])
+			ends.push_back(tour.Positions[candidate]);
+		for (unsigned int candidate : neighbours[tour.Order[i].Island])
+			ends.push_back(static_cast<int>(tour.Positions[candidate]) - 1);
+
+		Vec3i prev = tour.GetExit(i - 1);
+		for (int j : ends)
+		{
+			if (j < i)
+				continue;
+
+			//reversed segment is entered through j's exit and left through i's entry
+			long long before = GetDistance(prev, tour.GetEntry(i)) + tour.GetLink(tour.GetExit(j), j + 1);
+			long long after = GetDistance(prev, tour.GetExit(j)) + tour.GetLink(tour.GetEntry(i), j + 1);
+			if (after < before)
+			{
+				tour.Reverse(i, j);
+				improved = true;
+				break;
+			}
+		}
+	}
+
+	return improved;
+}
+
+//moves segments of up to 'MaxSegmentLength' islands next to one of the islands near the segment's start (possibly reversing them)
+static bool OptimizeOrOpt(TourState& tour, const std::vector<std::vector<unsigned int>>& neighbours)
+{
+	bool improved = false;
+	for (int i = 0; i < tour.Size(); i++)
+	{
+		if (i % 64 == 0 && tour.CheckTime())
+			break;
+
+		//positions stay signed, position -1 is the tour's start
+		for (unsigned int length = 1; length <= MaxSegmentLength && length <= static_cast<unsigned int>(tour.Size() - i); length++)
+		{
+			int last = i + static_cast<int>(length) - 1;
+			Vec3i prev = tour.GetExit(i - 1);
+			Vec3i entry = tour.GetEntry(i);
+			Vec3i exit = tour.GetExit(last);
+			long long removed = GetDistance(prev, entry) + tour.GetLink(exit, last + 1) - tour.GetLink(prev, last + 1);
+
+			int bestTarget = -1;
+			bool bestReversed = false;
+			long long bestGain = 0;
+			for (unsigned int candidate : neighbours[tour.Order[i].Island])
+			{
+				int p = tour.Positions[candidate]; //segment would be inserted after p
+				if (p >= i - 1 && p <= last)
+					continue;
+
+				Vec3i pExit = tour.GetExit(p);
+				long long link = tour.GetLink(pExit, p + 1);
+				long long added = GetDistance(pExit, entry) + tour.GetLink(exit, p + 1) - link;
+				long long addedReversed = GetDistance(pExit, exit) + tour.GetLink(entry, p + 1) - link;
+
+				if (removed - added > bestGain)
+				{
+					bestGain = removed - added;
+					bestTarget = p;
+					bestReversed = false;
+				}
+
+				if (removed - addedReversed > bestGain)
+				{
+					bestGain = removed - addedReversed;
+					bestTarget = p;
+					bestReversed = true;
+				}
+			}
+
+			if (bestTarget < 0)
+				continue;
+
+			if (bestReversed)
+				tour.Reverse(i, last);
+
+			if (bestTarget > last)
+			{
+				std::rotate(tour.Order.begin() + i, tour.Order.begin() + last + 1, tour.Order.begin() + bestTarget + 1);
+				tour.UpdatePositions(i, bestTarget);
+			}
+			else
+			{
+				std::rotate(tour.Order.begin() + bestTarget + 1, tour.Order.begin() + i, tour.Order.begin() + last + 1);
+				tour.UpdatePositions(bestTarget + 1, last);
+			}
+
+			improved = true;
+			break;
+		}
+	}
+
+	return improved;
+}
+
+TourGraph GetTourGraph(const std::vector<std::vector<Vec3i>>& islands, bool neighbours)
+{
+	//every exit is also an entry of the reverse variant, so the points cover both ends of each island
+	TourGraph graph;
+	for (const std::vector<Vec3i>& island : islands)
+	{
+		graph.Ends.push_back(GetIslandEnds(island));
+		for (unsigned char variant = 0; variant < TourVariants; variant++)
+			graph.Points.push_back(graph.Ends.back().Entry[variant]);
+	}
+
+	if (!neighbours || islands.size() < 2)
+		return graph;
+
+	PointGrid grid = PointGrid(graph.Points);
+	graph.Neighbours = std::vector<std::vector<unsigned int>>(islands.size());
+	std::vector<unsigned int> nearby;
+	for (unsigned int i = 0; i < islands.size(); i++)
+	{
+		nearby.clear();
+		for (unsigned char variant = 0; variant < TourVariants; variant++)
+			grid.FindNearby(graph.Ends[i].Entry[variant], NeighbourCount + TourVariants, nearby);
+
+		for (unsigned int point : nearby)
+		{
+			unsigned int island = point / TourVariants;
+			if (island != i && std::find(graph.Neighbours[i].begin(), graph.Neighbours[i].end(), island) == graph.Neighbours[i].end())
+				graph.Neighbours[i].push_back(island);
+		}
+	}
+
+	return graph;
+}
+
+std::vector<TourStop> PlanTour(const std::vector<std::vector<Vec3i>>& islands, Vec3i start, unsigned int budget)
+{
+	return PlanTour(GetTourGraph(islands, budget > 0), start, budget);
+}
+
+std::vector<TourStop> PlanTour(const TourGraph& graph, Vec3i start, unsigned int budget)
+{
+	std::vector<TourStop> order;
+	const std::vector<IslandEnds>& ends = graph.Ends;
+	if (ends.empty())
+		return order;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budget);
+
+	//greedy nearest neighbour tour
+	PointGrid grid = PointGrid(graph.Points);
+	Vec3i pos = start;
+	for (unsigned int n = 0; n < ends.size(); n++)
+	{
+		unsigned int nearest = grid.FindNearest(pos);
+		TourStop stop = { nearest / TourVariants, static_cast<unsigned char>(nearest % TourVariants) };
+		for (unsigned char variant = 0; variant < TourVariants; variant++)
+			grid.Remove(stop.Island * TourVariants + variant);
+
+		order.push_back(stop);
+		pos = ends[stop.Island].Exit[stop.Variant];
+	}
+
+	if (budget == 0 || ends.size() < 2)
+		return order;
+
+	PointGrid fullGrid = PointGrid(graph.Points);
+	std::vector<unsigned int> startNeighbours;
+	std::vector<unsigned int> nearby;
+	fullGrid.FindNearby(start, NeighbourCount * TourVariants, nearby);
+	for (unsigned int point : nearby)
+	{
+		if (std::find(startNeighbours.begin(), startNeighbours.end(), point / TourVariants) == startNeighbours.end())
+			startNeighbours.push_back(point / TourVariants);
+	}
+
+	TourState tour = TourState(ends, order, start);
+	tour.Deadline = deadline;
+	while (!tour.CheckTime())
+	{
+		bool improved = OptimizeVariants(tour);
+		improved = OptimizeTwoOpt(tour, graph.Neighbours, startNeighbours) || improved;
+		improved = OptimizeOrOpt(tour, graph.Neighbours) || improved;
+		if (!improved)
+			break;
+	}
+
+	return order;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <vector>
+#include "vec3i.hpp"
+
+//islands are lists of ranges (X - start X coordinate, Z - end X coordinate, Y - Y coordinate) ordered by row (top to bottom) and X
+//each island can be built in one of four variants, which decide the row it starts from and direction of the first row
+const unsigned char TourBottomUp = 1;
+const unsigned char TourRightToLeft = 2;
+const unsigned char TourVariants = 4;
+
+struct TourStop
+{
+	unsigned int Island;
+	unsigned char Variant;
+};
+
+//ends of the island's serpentine path for each variant, travel distance inside of the island and the variant which goes through it backwards
+struct IslandEnds
+{
+	Vec3i Entry[TourVariants];
+	Vec3i Exit[TourVariants];
+	unsigned int Cost[TourVariants];
+	unsigned char Reverse[TourVariants];
+};
+
+//calls 'visit(range, left2right)' for each range of the island in the order they're built in
+//rows are built in serpentine order and ranges sharing a row are built in the row's direction
+template <typename Visitor>
+void VisitIsland(const std::vector<Vec3i>& island, unsigned char variant, Visitor visit)
+{
+	bool bottomUp = variant & TourBottomUp;
+	bool left2right = !(variant & TourRightToLeft);
+	unsigned int count = island.size();
+
+	for (unsigned int done = 0; done < count;)
+	{
+		//row occupies [rowBegin, rowEnd) in the island
+		unsigned int rowBegin, rowEnd;
+		if (bottomUp)
+		{
+			rowEnd = count - done;
+			rowBegin = rowEnd - 1;
+			while (rowBegin > 0 && island[rowBegin - 1].Y == island[rowEnd - 1].Y)
+				rowBegin--;
+		}
+		else
+		{
+			rowBegin = done;
+			rowEnd = rowBegin + 1;
+			while (rowEnd < count && island[rowEnd].Y == island[rowBegin].Y)
+				rowEnd++;
+		}
+
+		for (unsigned int r = 0; r < rowEnd - rowBegin; r++)
+			visit(island[left2right ? rowBegin + r : rowEnd - r - 1], left2right);
+
+		left2right = !left2right;
+		done += rowEnd - rowBegin;
+	}
+}
+
+//parts of the tour planning which don't depend on the tour's start, so they can be prepared ahead (and on another thread)
+struct TourGraph
+{
+	std::vector<IslandEnds> Ends;
+	std::vector<Vec3i> Points; //entries of all variants, point index is island index * 4 + variant
+	std::vector<std::vector<unsigned int>> Neighbours; //islands near each of the island's ends, only needed to improve the tour
+};
+
+IslandEnds GetIslandEnds(const std::vector<Vec3i>& island);
+
+TourGraph GetTourGraph(const std::vector<std::vector<Vec3i>>& islands, bool neighbours);
+
+//orders islands to minimize travel starting from 'start' (manhattan distance in XY plane)
+//greedy nearest neighbour tour is improved with variant selection, 2-opt and or-opt moves until it stops improving or 'budget' milliseconds pass
+std::vector<TourStop> PlanTour(const std::vector<std::vector<Vec3i>>& islands, Vec3i start, unsigned int budget);
+std::vector<TourStop> PlanTour(const TourGraph& graph, Vec3i start, unsigned int budget); //graph has to have neighbours if 'budget' isn't zero
+
+//travel distance of the tour, including travel inside of the islands
+unsigned long long GetTourLength(const std::vector<IslandEnds>& ends, const std::vector<TourStop>& tour, Vec3i start);
@@ -3,17 +3,18 @@
 #include <fstream>
 #include <format>
 #include <vector>
+#include <algorithm>
+#include <limits>
 #include "turtle.hpp"
 
 
 Vec3i Turtle::RelativeToGlobal(TurtleRotation rotation, Vec3i pos)
 {
-    int gx, gy;
+    int gx = pos.X; //north
+    int gy = pos.Y;
     switch (rotation)
     {
         case TurtleRotation::North:
-            gx = pos.X;
-            gy = pos.Y;
             break;
         case TurtleRotation::East:
             gx = pos.Y;
@@ -62,52 +63,166 @@ void Turtle::WriteByte(unsigned char byte, unsigned int repeats)
     }
 }
 
-void Turtle::MoveByRelative(Vec3i move, bool zfirst)
+void Turtle::WriteAction(TurtleAction action, unsigned int repeats)
 {
+    if (!WriteInstructions || repeats == 0)
+        return;
+
+    //same action as the last one written, its run is rewritten with the new length (unless it was already flushed)
+    if (RunAction == action && RunEnd == GetInstructionCount() && RunStart >= FlushedSize)
+    {
+        repeats += RunLength;
+        Instructions.resize(RunStart - FlushedSize);
+    }
+
+    while (repeats > 0)
+    {
+        RunStart = GetInstructionCount();
+        RunLength = std::min(repeats, MaxRepeats);
+        repeats -= RunLength;
+
+        if (RunLength < MinRepeats)
+        {
+            WriteByte(action, RunLength);
+            continue;
+        }
+
+        WriteByte(TurtleAction::Repeat);
+        WriteByte(action);
+        WriteByte(RunLength);
+    }
+
+    RunAction = action;
+    RunEnd = GetInstructionCount();
+}
+
+//number of turns needed to go from one heading to another
+static unsigned int GetTurnCount(unsigned char from, unsigned char to)
+{
+    unsigned int rightTurns = (to - from + 4) % 4;
+    return rightTurns == 3 ? 1 : rightTurns;
+}
+
+MovePlan Turtle::PlanMove(Vec3i move, RotationRequest rotation)
+{
+    //plans are compared in the order they're listed and the first cheapest one is taken, the first one is
+    //the simplest plan (Y leg first, without turning, then turn once towards X leg and move forward)
+    unsigned char xHeadings[2] = { static_cast<unsigned char>(move.X < 0 ? 3 : 1), static_cast<unsigned char>(move.X < 0 ? 1 : 3) };
+    unsigned char yHeadings[2] = { 0, 2 };
+    Vec3i absMove = move.Abs();
+    unsigned int moveCost = (absMove.X + absMove.Y) * Costs.Move + absMove.Z * Costs.Vertical;
+
+    MovePlan best;
+    best.Cost = std::numeric_limits<unsigned int>::max();
+    for (int xFirst = 0; xFirst < 2; xFirst++)
+    {
+        for (unsigned char yHeading : yHeadings)
+        {
+            for (unsigned char xHeading : xHeadings)
+            {
+                //legs in the order they're traveled, zero length legs don't need any turns
+                unsigned char headings[2] = { xFirst ? xHeading : yHeading, xFirst ? yHeading : xHeading };
+                int lengths[2] = { xFirst ? move.X : move.Y, xFirst ? move.Y : move.X };
+
+                unsigned char heading = 0;
+                unsigned int turns = 0;
+                for (int leg = 0; leg < 2; leg++)
+                {
+                    if (lengths[leg] == 0)
+                        continue;
+                    turns += GetTurnCount(heading, headings[leg]);
+                    heading = headings[leg];
+                }
+
+                //either of two opposite rotations is fine, the closer one is taken
+                unsigned char finalHeading = heading;
+                if (rotation == RotationRequest::NorthOrSouth || rotation == RotationRequest::EastOrWest)
+                {
+                    unsigned char north = (TurtleRotation::North - Rotation + 4) % 4;
+                    finalHeading = (heading - north + 4) % 2 == (rotation == RotationRequest::EastOrWest) ? heading : (heading + 1) % 4;
+                }
+                else if (rotation != RotationRequest::Any)
+                {
+                    finalHeading = (static_cast<unsigned char>(rotation) - Rotation + 4) % 4;
+                }
+                turns += GetTurnCount(heading, finalHeading);
+
+                unsigned int cost = moveCost + turns * Costs.Turn;
+                if (cost < best.Cost)
+                    best = { static_cast<bool>(xFirst), yHeading, xHeading, finalHeading, turns, cost };
+            }
+        }
+    }
+
+    return best;
+}
+
+void Turtle::MoveByRelative(Vec3i move, bool zfirst, RotationRequest rotation)
+{
+    MovePlan plan = PlanMove(move, rotation);
+
     Vec3i globalMove = RelativeToGlobal(Rotation, move);
     Pos += globalMove;
+    Moves += abs(move.X) + abs(move.Y) + abs(move.Z);
+    FuelLevel -= abs(move.X) + abs(move.Y) + abs(move.Z);
     MaxPos = Vec3i::Max(MaxPos, Pos);
     MinPos = Vec3i::Min(MinPos, Pos);
-    Rotation = move.X == 0 ? Rotation : IncrementRotation(Rotation, move.X < 0);
 
-    TurtleAction xact = move.X > 0 ? TurtleAction::TurnRight : TurtleAction::TurnLeft;
-    TurtleAction yact = move.Y > 0 ? TurtleAction::Forward : TurtleAction::Back;
-    TurtleAction zact = move.Z > 0 ? TurtleAction::Up : TurtleAction::Down;
+    unsigned char heading = 0;
+    auto turn = [&](unsigned char to)
+    {
+        unsigned int rightTurns = (to - heading + 4) % 4;
+        WriteAction(rightTurns == 3 ? TurtleAction::TurnLeft : TurtleAction::TurnRight, rightTurns == 3 ? 1 : rightTurns);
+        heading = to;
+    };
 
-    Vec3i absMove = move.Abs();
+    //turtle moves backwards when it's facing away from the leg's direction
+    auto leg = [&](int length, unsigned char legHeading, unsigned char positiveHeading)
+    {
+        if (length == 0)
+            return;
+        turn(legHeading);
+        WriteAction((length > 0) == (legHeading == positiveHeading) ? TurtleAction::Forward : TurtleAction::Back, abs(length));
+    };
 
-    if (zfirst)
-        WriteByte(zact, absMove.Z);
+    TurtleAction zact = move.Z > 0 ? TurtleAction::Up : TurtleAction::Down;
+    unsigned int absZ = abs(move.Z);
 
-    if (move.Y != 0)
-        WriteByte(yact, absMove.Y);
+    if (zfirst)
+        WriteAction(zact, absZ);
 
-    if (move.X != 0)
+    if (plan.XFirst)
     {
-        WriteByte(xact);
-        WriteByte(TurtleAction::Forward, absMove.X);
+        leg(move.X, plan.XHeading, 1);
+        leg(move.Y, plan.YHeading, 0);
     }
+    else
+    {
+        leg(move.Y, plan.YHeading, 0);
+        leg(move.X, plan.XHeading, 1);
+    }
+    turn(plan.FinalHeading);
 
     if (!zfirst)
-        WriteByte(zact, absMove.Z);
+        WriteAction(zact, absZ);
+
+    Rotation = static_cast<TurtleRotation>((Rotation + heading) % 4);
 }
 
-void Turtle::MoveByGlobal(Vec3i move, bool zfirst)
+void Turtle::MoveByGlobal(Vec3i move, bool zfirst, RotationRequest rotation)
 {
     Vec3i relMove = GlobalToRelative(Rotation, move);
-    MoveByRelative(relMove, zfirst);
+    MoveByRelative(relMove, zfirst, rotation);
 }
 
-void Turtle::MoveToGlobal(Vec3i pos, bool zfirst)
+void Turtle::MoveToGlobal(Vec3i pos, bool zfirst, RotationRequest rotation)
 {
-    MoveByGlobal(pos - Pos, zfirst);
+    MoveByGlobal(pos - Pos, zfirst, rotation);
 }
 
-void Turtle::SetRotation(TurtleRotation rotation)
+void Turtle::SetRotation(RotationRequest rotation)
 {
-    int turns = rotation - Rotation;
-    Rotation = rotation;
-    WriteByte(turns > 0 ? TurtleAction::TurnRight : TurtleAction::TurnLeft, abs(turns));
+    MoveByRelative(Vec3i(0), false, rotation);
 }
 
 void Turtle::Dig(PlaceDigDirection dir)
@@ -115,13 +230,13 @@ void Turtle::Dig(PlaceDigDirection dir)
     switch (dir)
     {
     case PlaceDigDirection::Straight:
-        WriteByte(TurtleAction::Dig);
+        WriteAction(TurtleAction::Dig);
         break;
     case PlaceDigDirection::Above:
-        WriteByte(TurtleAction::DigUp);
+        WriteAction(TurtleAction::DigUp);
         break;
     case PlaceDigDirection::Below:
-        WriteByte(TurtleAction::DigDown);
+        WriteAction(TurtleAction::DigDown);
         break;
     }
 }
@@ -131,13 +246,13 @@ void Turtle::Place(PlaceDigDirection dir)
     switch (dir)
     {
     case PlaceDigDirection::Straight:
-        WriteByte(TurtleAction::Place);
+        WriteAction(TurtleAction::Place);
         break;
     case PlaceDigDirection::Above:
-        WriteByte(TurtleAction::PlaceUp);
+        WriteAction(TurtleAction::PlaceUp);
         break;
     case PlaceDigDirection::Below:
-        WriteByte(TurtleAction::PlaceDown);
+        WriteAction(TurtleAction::PlaceDown);
         break;
     }
 }
@@ -176,22 +291,360 @@ void Turtle::Refuel(unsigned char amount)
     WriteByte(amount);
 }
 
-void Turtle::WriteToFile(std::filesystem::path path, std::vector<std::string>& mats)
+void Turtle::ReserveRefuel(unsigned char mat)
 {
-    std::fstream file = std::fstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
-    if (!file.is_open())
-        throw std::runtime_error("Failed to create output file.");
+    if (!WriteInstructions)
+        return;
 
-    //writing material names
+    FinishRefuel();
+    FuelMaterial = mat;
+    RefuelBlock = GetInstructionCount();
+    RefuelLevel = FuelLevel;
+    WriteByte(TurtleAction::None, RefuelBlockSize);
+}
+
+void Turtle::FinishRefuel()
+{
+    if (!WriteInstructions)
+        return;
+
+    if (RefuelBlock == NoRefuel)
+    {
+        if (FuelLevel < 0)
+            throw std::runtime_error(std::format("Turtle needs {} more fuel to get to the first refill position.", -FuelLevel));
+        return;
+    }
+
+    //turtle consumes only as many items as fit under the fuel limit, the rest would stay in the slot
+    long long used = RefuelLevel - FuelLevel;
+    long long items = FuelLevel < 0 ? (-FuelLevel + FuelPerItem - 1) / FuelPerItem : 0;
+    if (items > 0 && (RefuelLevel + items * FuelPerItem > FuelLimit || items > MaxRefuelStacks * StackSize))
+        throw std::runtime_error(std::format("Turtle needs {} fuel to get to the next refill position, it can't take that much at once (fuel limit is {}).", used, FuelLimit));
+
+    unsigned char block[RefuelBlockSize] = {};
+    unsigned char* b = block;
+    if (items > 0)
+    {
+        *b++ = TurtleAction::SelectSlot;
+        *b++ = 1;
+    }
+
+    for (long long left = items; left > 0; left -= StackSize)
+    {
+        unsigned char amount = std::min<long long>(left, StackSize);
+        *b++ = TurtleAction::Request;
+        *b++ = FuelMaterial;
+        *b++ = amount;
+        *b++ = TurtleAction::Refuel;
+        *b++ = amount;
+    }
+
+    PatchInstructions(RefuelBlock, block, RefuelBlockSize);
+    FuelLevel += items * FuelPerItem;
+    RefuelBlock = NoRefuel;
+}
+
+//instruction decoded by the optimizer, runs of the same action are a single instruction
+struct PeepholeInstruction
+{
+    unsigned char Action;
+    unsigned int Count = 1; //repeats for actions without following bytes, size for request batches
+    unsigned char Operands[2] = {};
+    size_t Offset = 0; //offset of the instruction in the original instructions
+};
+
+static unsigned int GetOperandCount(unsigned char action)
+{
+    switch (action)
+    {
+    case TurtleAction::Request:
+    case TurtleAction::Repeat:
+        return 2;
+    case TurtleAction::SelectSlot:
+    case TurtleAction::Unload:
+    case TurtleAction::Refuel:
+    case TurtleAction::RequestBatch: //number of requests, the requests themselves are handled separately
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+//moves in opposite directions cancel each other out, moves in the same direction are merged
+static void AddMove(std::vector<PeepholeInstruction>& out, unsigned char action, unsigned int count)
+{
+    unsigned char opposite;
+    switch (action)
+    {
+    case TurtleAction::Forward: opposite = TurtleAction::Back; break;
+    case TurtleAction::Back: opposite = TurtleAction::Forward; break;
+    case TurtleAction::Up: opposite = TurtleAction::Down; break;
+    default: opposite = TurtleAction::Up; break;
+    }
+
+    while (count > 0 && !out.empty() && out.back().Action == opposite)
+    {
+        unsigned int cancelled = std::min(count, out.back().Count);
+        count -= cancelled;
+        out.back().Count -= cancelled;
+        if (out.back().Count == 0)
+            out.pop_back();
+    }
+
+    if (count == 0)
+        return;
+
+    if (!out.empty() && out.back().Action == action)
+        out.back().Count += count;
+    else
+        out.push_back({ action, count });
+}
+
+//consecutive turns are replaced with the shortest sequence with the same result
+static void AddTurn(std::vector<PeepholeInstruction>& out, unsigned char action, unsigned int count)
+{
+    int rightTurns = action == TurtleAction::TurnRight ? count % 4 : 4 - count % 4;
+    while (!out.empty() && (out.back().Action == TurtleAction::TurnLeft || out.back().Action == TurtleAction::TurnRight))
+    {
+        rightTurns += out.back().Action == TurtleAction::TurnRight ? out.back().Count % 4 : 4 - out.back().Count % 4;
+        out.pop_back();
+    }
+
+    rightTurns %= 4;
+    if (rightTurns == 3)
+        out.push_back({ TurtleAction::TurnLeft, 1 });
+    else if (rightTurns > 0)
+        out.push_back({ TurtleAction::TurnRight, static_cast<unsigned int>(rightTurns) });
+}
+
+size_t Turtle::Optimize(size_t* reserved)
+{
+    if (!WriteInstructions)
+        return GetInstructionCount();
+
+    //pending blocks still in memory (the caller's one and the pending refuel), the pass stops at the first one
+    std::vector<size_t*> blocks;
+    if (reserved && *reserved >= FlushedSize)
+        blocks.push_back(reserved);
+    if (RefuelBlock != NoRefuel && RefuelBlock >= FlushedSize)
+        blocks.push_back(&RefuelBlock);
+    size_t end = Instructions.size();
+    for (size_t* block : blocks)
+        end = std::min(end, *block - FlushedSize);
+
+    std::vector<PeepholeInstruction> out;
+    unsigned char slot = 0; //selected slot, zero if unknown
+    size_t lastSelect = std::numeric_limits<size_t>::max(); //select instruction whose slot wasn't used yet
+    unsigned char lastSelectFrom = 0; //slot selected before it
+
+    for (size_t i = 0; i < end;)
+    {
+        PeepholeInstruction instr = { Instructions[i] };
+        instr.Offset = i;
+        unsigned int operands = GetOperandCount(instr.Action);
+        if (i + operands >= end)
+            throw std::runtime_error("Truncated instruction.");
+
+        for (unsigned int o = 0; o < operands; o++)
+            instr.Operands[o] = Instructions[i + 1 + o];
+        i += 1 + operands;
+
+        if (instr.Action == TurtleAction::Repeat)
+        {
+            instr.Action = instr.Operands[0];
+            instr.Count = instr.Operands[1];
+        }
+        else if (instr.Action == TurtleAction::RequestBatch)
+        {
+            //requests follow the count, the whole instruction is copied as is
+            instr.Count = 2 + instr.Operands[0] * 3;
+            if (instr.Offset + instr.Count > end)
+                throw std::runtime_error("Truncated instruction.");
+            i = instr.Offset + instr.Count;
+        }
+
+        switch (instr.Action)
+        {
+        case TurtleAction::None:
+            break; //nothing to do
+        case TurtleAction::Forward:
+        case TurtleAction::Back:
+        case TurtleAction::Up:
+        case TurtleAction::Down:
+            AddMove(out, instr.Action, instr.Count);
+            break;
+        case TurtleAction::TurnLeft:
+        case TurtleAction::TurnRight:
+            AddTurn(out, instr.Action, instr.Count);
+            break;
+        case TurtleAction::SelectSlot:
+            if (instr.Operands[0] == slot)
+                break;
+
+            //previous select is dead if nothing used its slot, only moves and turns could be written after it
+            if (lastSelect < out.size())
+            {
+                out.erase(out.begin() + lastSelect);
+                slot = lastSelectFrom;
+                lastSelect = std::numeric_limits<size_t>::max();
+                if (instr.Operands[0] == slot)
+                    break;
+            }
+
+            lastSelect = out.size();
+            lastSelectFrom = slot;
+            slot = instr.Operands[0];
+            out.push_back(instr);
+            break;
+        default:
+            if (instr.Action > TurtleAction::RequestBatch)
+                throw std::runtime_error("Unknown action.");
+
+            //everything else uses the selected slot
+            lastSelect = std::numeric_limits<size_t>::max();
+            out.push_back(instr);
+            break;
+        }
+    }
+
+    //later passes can only change instructions after the last one which isn't a move, turn or select, nor the select before it (it's in use)
+    //starting the next pass at that select also gives it the selected slot, so passes over parts of the instructions give the same result as one pass over all of them
+    size_t select = out.size();
+    size_t final = out.size(); //first instruction which may still change, all of them if there's no such select
+    for (size_t k = 0; k < out.size(); k++)
+    {
+        if (out[k].Action == TurtleAction::SelectSlot)
+            select = k;
+        else if (out[k].Action > TurtleAction::TurnRight && select < out.size())
+            final = select;
+    }
+
+    size_t finalOffset = FlushedSize;
+    std::vector<unsigned char> optimized;
+    optimized.reserve(Instructions.size());
+    for (size_t k = 0; k < out.size(); k++)
+    {
+        PeepholeInstruction& instr = out[k];
+        if (k == final)
+            finalOffset = FlushedSize + optimized.size();
+
+        if (instr.Action == TurtleAction::RequestBatch)
+        {
+            optimized.insert(optimized.end(), Instructions.begin() + instr.Offset, Instructions.begin() + instr.Offset + instr.Count);
+            continue;
+        }
+
+        unsigned int operands = GetOperandCount(instr.Action);
+        if (operands > 0)
+        {
+            optimized.push_back(instr.Action);
+            optimized.insert(optimized.end(), instr.Operands, instr.Operands + operands);
+            continue;
+        }
+
+        for (unsigned int count = instr.Count; count > 0;)
+        {
+            unsigned int run = std::min(count, MaxRepeats);
+            count -= run;
+            if (run < MinRepeats)
+            {
+                optimized.insert(optimized.end(), run, instr.Action);
+            }
+            else
+            {
+                optimized.push_back(TurtleAction::Repeat);
+                optimized.push_back(instr.Action);
+                optimized.push_back(run);
+            }
+        }
+    }
+
+    //pending blocks and everything after them are kept as is
+    size_t shift = optimized.size();
+    optimized.insert(optimized.end(), Instructions.begin() + end, Instructions.end());
+    for (size_t* block : blocks)
+        *block = *block - end + shift;
+
+    Instructions = optimized;
+    RunAction = TurtleAction::None; //last run may have been changed
+    return finalOffset;
+}
+
+size_t Turtle::GetInstructionCount()
+{
+    return FlushedSize + Instructions.size();
+}
+
+void Turtle::PatchInstructions(size_t offset, const unsigned char* bytes, size_t count)
+{
+    if (!WriteInstructions)
+        return;
+
+    //part of the range which is still in memory
+    for (size_t i = std::max(offset, FlushedSize); i < offset + count; i++)
+    {
+        Instructions[i - FlushedSize] = bytes[i - offset];
+    }
+
+    //part of the range which was already flushed
+    if (offset < FlushedSize)
+    {
+        std::streampos end = OutputFile.tellp();
+        OutputFile.seekp(OutputInstructionsStart + static_cast<std::streamoff>(offset));
+        OutputFile.write(reinterpret_cast<const char*>(bytes), std::min(count, FlushedSize - offset));
+        OutputFile.seekp(end);
+    }
+}
+
+void Turtle::WriteMaterials(std::ostream& file, std::vector<std::string>& mats)
+{
     for (std::string name : mats)
     {
         file.write(reinterpret_cast<char*>(name.data()), name.size());
         file.put(0);
     }
     file.put(0); //two zeroes in a row signify the end of material data
+}
+
+void Turtle::WriteToFile(std::filesystem::path path, std::vector<std::string>& mats)
+{
+    std::fstream file = std::fstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to create output file.");
+
+    //writing material names
+    WriteMaterials(file, mats);
 
     //writing instructions
     file.write(reinterpret_cast<char*>(Instructions.data()), Instructions.size());
 
     file.close();
 }
+
+void Turtle::BeginStream(std::filesystem::path path, std::vector<std::string>& mats)
+{
+    OutputFile = std::fstream(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!OutputFile.is_open())
+        throw std::runtime_error("Failed to create output file.");
+
+    WriteMaterials(OutputFile, mats);
+    OutputInstructionsStart = OutputFile.tellp();
+    Flush(); //instructions written before streaming began
+}
+
+void Turtle::Flush(size_t end)
+{
+    if (!OutputFile.is_open())
+        return;
+
+    size_t count = std::min(end, GetInstructionCount()) - FlushedSize;
+    OutputFile.write(reinterpret_cast<char*>(Instructions.data()), count);
+    FlushedSize += count;
+    Instructions.erase(Instructions.begin(), Instructions.begin() + count);
+}
+
+void Turtle::EndStream()
+{
+    Flush();
+    OutputFile.close();
+}
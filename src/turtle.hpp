@@ -1,5 +1,7 @@
 #pragma once
 #include <filesystem>
+#include <fstream>
+#include <limits>
 #include <vector>
 #include "vec3i.hpp"
 
@@ -7,6 +9,11 @@
 const unsigned int StackSize = 64;
 const unsigned int InventorySize = 16;
 const unsigned int MaxMaterials = 16;
+const unsigned int MinRepeats = 4; //shorter runs of the same action are written as is (repeat instruction is 3 bytes long)
+const unsigned int MaxRepeats = 255;
+const unsigned int MaxRefuelStacks = 4; //most fuel items requested at a single refill, in stacks
+const unsigned int RefuelBlockSize = 2 + MaxRefuelStacks * 5; //select slot instruction and a request and refuel instruction for each stack
+const size_t NoRefuel = static_cast<size_t>(-1);
 
 enum TurtleAction : unsigned char
 {
@@ -26,7 +33,9 @@ enum TurtleAction : unsigned char
     SelectSlot, //following byte specifies the slot number
     Request, //first following byte specifies the material number and a second one specifies the amount to request
     Unload, //first following byte specifies the amount to unload
-    Refuel //first following byte specifies the amount of fuel to consume
+    Refuel, //first following byte specifies the amount of fuel to consume
+    Repeat, //first following byte specifies the action (one without any following bytes) and a second one how many times to perform it
+    RequestBatch //first following byte specifies the number of requests, each of them is 3 bytes long (slot number, material number and amount)
 };
 
 enum TurtleRotation : unsigned char
@@ -37,6 +46,19 @@ enum TurtleRotation : unsigned char
     West
 };
 
+//rotation needed by the action following a move, first four are the same as in 'TurtleRotation'
+//when the following action is a move it can be done backwards as well, so either of two opposite rotations (or any) is fine
+enum class RotationRequest : unsigned char
+{
+    North,
+    East,
+    South,
+    West,
+    Any,
+    NorthOrSouth,
+    EastOrWest
+};
+
 enum PlaceDigDirection : unsigned char
 {
     Straight,
@@ -44,6 +66,25 @@ enum PlaceDigDirection : unsigned char
     Below
 };
 
+//game time in ticks each action takes, used to pick the cheapest way of moving
+struct MoveCosts
+{
+    unsigned int Move = 8;
+    unsigned int Turn = 8;
+    unsigned int Vertical = 8;
+};
+
+//relative move split into two horizontal legs, headings are relative to the turtle's rotation (number of right turns)
+struct MovePlan
+{
+    bool XFirst = false;
+    unsigned char YHeading = 0; //forward or back
+    unsigned char XHeading = 1; //right or left
+    unsigned char FinalHeading = 0;
+    unsigned int Turns = 0;
+    unsigned int Cost = 0;
+};
+
 struct Turtle
 {
     //those x y z coordinates are global, meaning that they are relative to coordinate's system beginning/north oriented
@@ -53,18 +94,45 @@ struct Turtle
     TurtleRotation Rotation = TurtleRotation::North;
     unsigned char SelectedSlot = 0; //zero means that slot is in uncertain state
 
+    MoveCosts Costs;
+    unsigned long long Moves = 0; //moves made so far (vertical ones included)
+
+    //fuel level is tracked from moves, refuel instructions are reserved at each refill position and filled in at the next one (or at the end)
+    //once it's known how much fuel the turtle needs to get there, 'FuelLevel' doesn't include the pending refuel
+    unsigned int FuelPerItem = 80; //coal
+    unsigned int FuelLimit = 20000; //100000 for advanced turtles, the fuel level is never above it
+    long long FuelLevel = 0;
+    size_t RefuelBlock = NoRefuel; //offset of the pending refuel block
+    long long RefuelLevel = 0; //fuel level at the pending refuel
+    unsigned char FuelMaterial = 0;
+
     bool WriteInstructions = true; //if not set then position, rotation and other parameters will be updated but no instruction will be written
     std::vector<unsigned char> Instructions;
 
+    //when streaming instructions are periodically flushed to 'OutputFile' and removed from 'Instructions'
+    //offsets used by 'GetInstructionCount' and 'PatchInstructions' always count from the first instruction ever written
+    std::fstream OutputFile;
+    std::streampos OutputInstructionsStart = 0;
+    size_t FlushedSize = 0;
+
+    //last run of the same action written by 'WriteAction', following writes of the same action extend it
+    TurtleAction RunAction = TurtleAction::None;
+    size_t RunStart = 0;
+    size_t RunEnd = 0;
+    unsigned int RunLength = 0;
+
     static Vec3i RelativeToGlobal(TurtleRotation rotation, Vec3i pos);
     static Vec3i GlobalToRelative(TurtleRotation rotation, Vec3i pos);
     static TurtleRotation IncrementRotation(TurtleRotation rotation, bool left);
 
     void WriteByte(unsigned char byte, unsigned int repeats = 1);
-    void MoveByRelative(Vec3i move, bool zfirst = false);
-    void MoveByGlobal(Vec3i move, bool zfirst = false);
-    void MoveToGlobal(Vec3i pos, bool zfirst = false);
-    void SetRotation(TurtleRotation rotation);
+    void WriteAction(TurtleAction action, unsigned int repeats = 1); //long runs are written as repeat instructions, action can't have any following bytes
+    //'rotation' is the one needed by the following action, the move is planned so that the turtle ends up in it with the least turns
+    MovePlan PlanMove(Vec3i move, RotationRequest rotation = RotationRequest::Any);
+    void MoveByRelative(Vec3i move, bool zfirst = false, RotationRequest rotation = RotationRequest::Any);
+    void MoveByGlobal(Vec3i move, bool zfirst = false, RotationRequest rotation = RotationRequest::Any);
+    void MoveToGlobal(Vec3i pos, bool zfirst = false, RotationRequest rotation = RotationRequest::Any);
+    void SetRotation(RotationRequest rotation);
     void Dig(PlaceDigDirection dir);
     void Place(PlaceDigDirection dir);
     void SelectSlot(unsigned char slot);
@@ -72,5 +140,23 @@ struct Turtle
     void Unload(unsigned char amount);
     void Refuel(unsigned char amount);
 
+    //fills in the pending refuel (if any) and reserves a new one at the current position, 'mat' is the fuel's material number
+    //throws if the turtle can't get here with the fuel it had at the previous refuel (or at the start)
+    void ReserveRefuel(unsigned char mat);
+    void FinishRefuel(); //fills in the pending refuel, called once the turtle has made its last move
+
+    //peephole pass over instructions which weren't flushed yet, removes moves and turns cancelling each other out, shortens turn sequences,
+    //removes NOPs and selects of slots which are never used, 'reserved' is an offset of a block which will be patched later, the pass stops
+    //at it (or at the pending refuel block) and keeps the rest as is, the offsets are updated to their new positions
+    //returns the offset up to which later passes can't change the instructions, flushing only those gives the same output as a single pass
+    size_t Optimize(size_t* reserved = nullptr);
+
+    size_t GetInstructionCount();
+    void PatchInstructions(size_t offset, const unsigned char* bytes, size_t count); //overwrites already written instructions, even flushed ones
+
+    static void WriteMaterials(std::ostream& file, std::vector<std::string>& mats);
     void WriteToFile(std::filesystem::path path, std::vector<std::string>& mats);
+    void BeginStream(std::filesystem::path path, std::vector<std::string>& mats);
+    void Flush(size_t end = std::numeric_limits<size_t>::max()); //writes instructions before offset 'end' to the output file
+    void EndStream();
 };
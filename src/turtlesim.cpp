@@ -0,0 +1,441 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include "turtle.hpp"
+#include "voxel.hpp"
+
+//estimated duration of actions in game ticks (20 ticks per second), movement and turning animations take 8 ticks
+const unsigned int MoveTicks = 8;
+const unsigned int TurnTicks = 8;
+const unsigned int PlaceTicks = 1;
+const unsigned int DigTicks = 8;
+const unsigned int RequestTicks = 20; //provider has to find the items and push them through the wired network
+const unsigned int EventTicks = 4; //driver processes events for 0.2 seconds in parallel with every instruction it reads
+
+const unsigned int MaxReportedErrors = 10;
+
+struct Slot
+{
+	unsigned char Material = 0; //material number from the instruction file (1 based), zero if the slot is empty
+	unsigned int Count = 0;
+};
+
+struct SimStats
+{
+	unsigned long long Ticks = 0;
+	unsigned long long Instructions = 0;
+	unsigned long long Moves = 0;
+	unsigned long long Turns = 0;
+	unsigned long long Placed = 0;
+	unsigned long long Dug = 0;
+	unsigned long long FuelUsed = 0;
+	unsigned int Refills = 0; //visits to a refill position, a visit starts with the first request after the turtle has moved
+	unsigned int Requests = 0;
+	unsigned int Refuels = 0;
+	unsigned int Errors = 0;
+};
+
+//blocks placed by the turtle, keyed by packed global position
+typedef std::unordered_map<uint64_t, unsigned char> World;
+
+uint64_t GetKey(Vec3i pos)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(pos.X) & 0x1FFFFF) << 42) |
+		(static_cast<uint64_t>(static_cast<uint32_t>(pos.Y) & 0x1FFFFF) << 21) |
+		(static_cast<uint64_t>(static_cast<uint32_t>(pos.Z) & 0x1FFFFF));
+}
+
+//executes instructions with the same semantics as 'nextAction' in turtle-driver.lua, refill requests are always fulfilled
+struct SimTurtle
+{
+	Vec3i Pos;
+	TurtleRotation Rotation = TurtleRotation::North;
+	int Fuel = 0;
+	int FuelPerItem = 80; //coal
+	int FuelLimit = 20000;
+	bool MovedSinceRequest = true;
+	unsigned char SelectedSlot = 1;
+	Slot Inventory[InventorySize];
+	std::vector<std::string> Materials;
+	World& Blocks;
+	SimStats Stats;
+
+	std::vector<unsigned char> Instructions;
+	size_t Index = 0;
+	size_t ActionOffset = 0;
+
+	SimTurtle(World& blocks, Vec3i start, int fuel, int fuelPerItem, int fuelLimit) : Blocks(blocks)
+	{
+		Pos = start;
+		Fuel = fuel;
+		FuelPerItem = fuelPerItem;
+		FuelLimit = fuelLimit;
+	}
+
+	void Fail(std::string message)
+	{
+		if (Stats.Errors++ < MaxReportedErrors)
+			std::cout << "Action has failed: " << ActionOffset << " - " << static_cast<int>(Instructions[ActionOffset]) << " - '" << message << "'.\n";
+	}
+
+	unsigned char ReadNext()
+	{
+		if (Index >= Instructions.size())
+			throw std::runtime_error("Unexpected end of instruction file.");
+		return Instructions[Index++];
+	}
+
+	void Move(Vec3i relative)
+	{
+		if (Fuel <= 0)
+		{
+			Fail("Out of fuel");
+			return;
+		}
+
+		Vec3i target = Pos + Turtle::RelativeToGlobal(Rotation, relative);
+		if (Blocks.contains(GetKey(target)))
+		{
+			Fail("Movement obstructed");
+			return;
+		}
+
+		Pos = target;
+		MovedSinceRequest = true;
+		Fuel--;
+		Stats.FuelUsed++;
+		Stats.Moves++;
+		Stats.Ticks += MoveTicks;
+	}
+
+	void Turn(bool left)
+	{
+		Rotation = Turtle::IncrementRotation(Rotation, left);
+		Stats.Turns++;
+		Stats.Ticks += TurnTicks;
+	}
+
+	void Place(Vec3i relative)
+	{
+		Stats.Ticks += PlaceTicks;
+		Slot& slot = Inventory[SelectedSlot - 1];
+		if (slot.Count == 0)
+		{
+			Fail("No items to place");
+			return;
+		}
+
+		uint64_t key = GetKey(Pos + Turtle::RelativeToGlobal(Rotation, relative));
+		if (Blocks.contains(key))
+		{
+			Fail("Cannot place block here");
+			return;
+		}
+
+		Blocks[key] = slot.Material;
+		Stats.Placed++;
+		if (--slot.Count == 0)
+			slot.Material = 0;
+	}
+
+	//terrain isn't simulated, digging always succeeds (items are dropped)
+	void Dig(Vec3i relative)
+	{
+		Stats.Ticks += DigTicks;
+		Stats.Dug++;
+		Blocks.erase(GetKey(Pos + Turtle::RelativeToGlobal(Rotation, relative)));
+	}
+
+	void CountRequest()
+	{
+		Stats.Requests++;
+		Stats.Ticks += RequestTicks;
+		Stats.Refills += MovedSinceRequest;
+		MovedSinceRequest = false;
+	}
+
+	//round trip to the provider is counted once per request instruction, a batch fills several slots at once
+	void Request(unsigned char slotNumber, unsigned char mat, unsigned char amount)
+	{
+		if (mat == 0 || mat > Materials.size())
+		{
+			Fail("Unknown material");
+			return;
+		}
+
+		if (slotNumber == 0 || slotNumber > InventorySize)
+		{
+			Fail("Slot number out of range");
+			return;
+		}
+
+		Slot& slot = Inventory[slotNumber - 1];
+		if (slot.Count > 0 && slot.Material != mat)
+		{
+			Fail("Slot is occupied by another material");
+			return;
+		}
+
+		slot.Material = mat;
+		slot.Count = std::min(slot.Count + amount, StackSize);
+	}
+
+	void Unload(unsigned char amount)
+	{
+		Stats.Ticks += RequestTicks;
+		Slot& slot = Inventory[SelectedSlot - 1];
+		slot.Count -= std::min<unsigned int>(slot.Count, amount);
+		if (slot.Count == 0)
+			slot.Material = 0;
+	}
+
+	//last material is the fuel
+	void Refuel(unsigned char amount)
+	{
+		Stats.Refuels++;
+		Slot& slot = Inventory[SelectedSlot - 1];
+		if (slot.Count > 0 && slot.Material != Materials.size())
+		{
+			Fail("Items in selected slot are not combustible");
+			return;
+		}
+
+		unsigned int items = std::min<unsigned int>({ slot.Count, amount, static_cast<unsigned int>(std::max(0, FuelLimit - Fuel) / FuelPerItem) });
+		Fuel += items * FuelPerItem;
+		slot.Count -= items;
+		if (slot.Count == 0)
+			slot.Material = 0;
+	}
+
+	void PerformAction(unsigned char action)
+	{
+		switch (action)
+		{
+		case TurtleAction::None: break;
+		case TurtleAction::Forward: Move(Vec3i(0, 1, 0)); break;
+		case TurtleAction::Back: Move(Vec3i(0, -1, 0)); break;
+		case TurtleAction::Up: Move(Vec3i(0, 0, 1)); break;
+		case TurtleAction::Down: Move(Vec3i(0, 0, -1)); break;
+		case TurtleAction::TurnLeft: Turn(true); break;
+		case TurtleAction::TurnRight: Turn(false); break;
+		case TurtleAction::Dig: Dig(Vec3i(0, 1, 0)); break;
+		case TurtleAction::DigUp: Dig(Vec3i(0, 0, 1)); break;
+		case TurtleAction::DigDown: Dig(Vec3i(0, 0, -1)); break;
+		case TurtleAction::Place: Place(Vec3i(0, 1, 0)); break;
+		case TurtleAction::PlaceUp: Place(Vec3i(0, 0, 1)); break;
+		case TurtleAction::PlaceDown: Place(Vec3i(0, 0, -1)); break;
+		case TurtleAction::SelectSlot:
+		{
+			unsigned char slot = ReadNext();
+			if (slot == 0 || slot > InventorySize)
+				Fail("Slot number out of range");
+			else
+				SelectedSlot = slot;
+			break;
+		}
+		case TurtleAction::Request:
+		{
+			unsigned char mat = ReadNext();
+			Request(SelectedSlot, mat, ReadNext());
+			CountRequest();
+			break;
+		}
+		case TurtleAction::Unload: Unload(ReadNext()); break;
+		case TurtleAction::Refuel: Refuel(ReadNext()); break;
+		case TurtleAction::Repeat:
+		{
+			unsigned char repeated = ReadNext();
+			unsigned char count = ReadNext();
+			if (repeated > TurtleAction::PlaceDown)
+			{
+				Fail("Action can't be repeated");
+				break;
+			}
+
+			for (unsigned int i = 0; i < count; i++)
+				PerformAction(repeated);
+			break;
+		}
+		case TurtleAction::RequestBatch:
+		{
+			unsigned char count = ReadNext();
+			for (unsigned int i = 0; i < count; i++)
+			{
+				unsigned char slot = ReadNext();
+				unsigned char mat = ReadNext();
+				Request(slot, mat, ReadNext());
+			}
+			CountRequest();
+			break;
+		}
+		default:
+			Fail("Unknown action");
+			break;
+		}
+	}
+
+	void Load(std::filesystem::path path)
+	{
+		std::ifstream file = std::ifstream(path, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("Failed to open instruction file.");
+
+		Instructions = std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+		//two zeroes in a row signify the end of material data
+		std::string str;
+		while (true)
+		{
+			unsigned char ch = ReadNext();
+			if (ch != 0)
+			{
+				str += ch;
+				continue;
+			}
+
+			if (str.empty())
+				break;
+			Materials.push_back(str);
+			str.clear();
+		}
+	}
+
+	void Run()
+	{
+		while (Index < Instructions.size())
+		{
+			ActionOffset = Index;
+			unsigned long long ticks = Stats.Ticks;
+			PerformAction(ReadNext());
+			Stats.Ticks = std::max(Stats.Ticks, ticks + EventTicks);
+			Stats.Instructions++;
+		}
+	}
+};
+
+std::string FormatTicks(unsigned long long ticks)
+{
+	unsigned long long seconds = ticks / 20;
+	return std::to_string(seconds / 3600) + "h " + std::to_string(seconds / 60 % 60) + "m " + std::to_string(seconds % 60) + "s";
+}
+
+void PrintStats(SimStats& stats)
+{
+	std::cout << "Instructions executed: " << stats.Instructions << "\n";
+	std::cout << "Estimated build time: " << FormatTicks(stats.Ticks) << " (" << stats.Ticks << " ticks)\n";
+	std::cout << "Distance travelled: " << stats.Moves << " blocks, turns: " << stats.Turns << "\n";
+	std::cout << "Fuel used: " << stats.FuelUsed << "\n";
+	std::cout << "Refills: " << stats.Refills << " (" << stats.Requests << " requests), refuels: " << stats.Refuels << "\n";
+	std::cout << "Blocks placed: " << stats.Placed << ", dug: " << stats.Dug << "\n";
+	std::cout << "Errors: " << stats.Errors << "\n";
+}
+
+int main()
+{
+	std::cout << "== turtlesim ==\n";
+
+	//each turtle builds in its own world, their blocks are merged afterwards
+	std::vector<World> worlds;
+	std::vector<SimStats> stats;
+	std::string str;
+	std::cout << "Turtles' starting fuel level: ";
+	int fuel;
+	std::cin >> fuel;
+	std::cout << "Fuel value of one fuel item (e.g. 80 for coal): ";
+	int fuelPerItem;
+	std::cin >> fuelPerItem;
+	std::cout << "Turtle's fuel limit (20000 for turtles, 100000 for advanced turtles): ";
+	int fuelLimit;
+	std::cin >> fuelLimit;
+	fuel = std::min(fuel, fuelLimit);
+	std::cin.ignore();
+
+	while (true)
+	{
+		std::cout << "Instruction file (empty string to stop inputting instruction files): ";
+		std::getline(std::cin, str);
+		if (str.empty())
+			break;
+
+		std::cout << "Turtle's starting position (X Y Z): ";
+		std::string pos;
+		std::getline(std::cin, pos);
+
+		worlds.emplace_back();
+		SimTurtle turtle = SimTurtle(worlds.back(), Vec3i::FromString(pos), fuel, fuelPerItem, fuelLimit);
+		turtle.Load(str);
+		turtle.Run();
+
+		std::cout << "-- " << str << " --\n";
+		std::cout << "Final position (X Y Z): " << turtle.Pos.X << " " << turtle.Pos.Y << " " << turtle.Pos.Z << ", fuel left: " << turtle.Fuel << "\n";
+		PrintStats(turtle.Stats);
+		stats.push_back(turtle.Stats);
+	}
+
+	if (stats.size() > 1)
+	{
+		unsigned long long ticks = 0;
+		for (SimStats& s : stats)
+			ticks = std::max(ticks, s.Ticks);
+		std::cout << "-- all turtles --\nEstimated build time: " << FormatTicks(ticks) << " (" << ticks << " ticks)\n";
+	}
+
+	std::cout << "Path to model to compare with (empty string to skip): ";
+	std::getline(std::cin, str);
+	if (!str.empty())
+	{
+		VoxelModel model = VoxelModel(str, VoxelStorage::Mapped);
+		std::cout << "Model's position (X Y Z): ";
+		std::string pos;
+		std::getline(std::cin, pos);
+		Vec3i offset = Vec3i::FromString(pos);
+
+		World placed;
+		unsigned long long overlapping = 0;
+		for (World& world : worlds)
+		{
+			for (auto& [key, mat] : world)
+				overlapping += !placed.emplace(key, mat).second;
+		}
+
+		//placed blocks are removed as they're matched, whatever is left is outside of the model
+		unsigned long long missing = 0;
+		unsigned long long wrong = 0;
+		for (unsigned int z = 0; z < model.Height; z++)
+		{
+			unsigned char* layer = model.GetLayer(z);
+			for (unsigned int y = 0; y < model.Length; y++)
+			{
+				for (unsigned int x = 0; x < model.Width; x++)
+				{
+					unsigned char mat = layer[static_cast<size_t>(y) * model.Width + x];
+					if (!mat)
+						continue;
+
+					auto it = placed.find(GetKey(Vec3i(x + offset.X, model.Length - y + offset.Y - 1, z + offset.Z)));
+					if (it == placed.end())
+					{
+						missing++;
+						continue;
+					}
+
+					wrong += it->second != mat;
+					placed.erase(it);
+				}
+			}
+			model.ReleaseLayer(z);
+		}
+
+		std::cout << "Missing blocks: " << missing << ", wrong material: " << wrong << ", outside of the model: " << placed.size() << ", placed by multiple turtles: " << overlapping << "\n";
+		std::cout << (missing || wrong || !placed.empty() || overlapping ? "Model doesn't match.\n" : "Model matches.\n");
+	}
+
+	std::cout << "Press enter to exit.";
+	std::cin.get();
+
+	return 0;
+}
@@ -1,4 +1,8 @@
 #pragma once
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
 
 struct Vec3i
 {
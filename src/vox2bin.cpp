@@ -1,290 +1,224 @@
 #include <iostream>
-#include "turtle.hpp"
-#include "voxel.hpp"
-
-//to determine the required amount of materials we reserve this block of memory before writing building instructions and incrementing
-//item count for materials, then when inventory gets fully used we go back to this block and fill it with request instructions
-//for now known material amounts
-unsigned int RefillCount;
-unsigned int RefillBlockBeginning;
-unsigned int SlotsUsed;
-unsigned char ItemCount[InventorySize];
-unsigned char Materials[InventorySize]; //material ID by slot
-unsigned char CurrentSlot[MaxMaterials]; //current slot used by the material
-
-void WriteRefillBlock(Turtle& turtle)
-{
-	for (int i = 0; i < InventorySize; i++)
-	{
-		if (!ItemCount[i])
-			continue;
-
-		unsigned int b = i * 5 + RefillBlockBeginning; //2 bytes per select slot instruction and another 3 per request instruction = 5 bytes
-
-		//select slot
-		turtle.Instructions[b] = TurtleAction::SelectSlot;
-		turtle.Instructions[b + 1] = i + 1;
-
-		//request material
-		turtle.Instructions[b + 2] = TurtleAction::Request;
-		turtle.Instructions[b + 3] = Materials[i] + 1;
-		turtle.Instructions[b + 4] = ItemCount[i];
-	}
-}
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "planner.hpp"
+#include "hollow.hpp"
 
-void RefillTurtle(Turtle& turtle, VoxelModel& model, std::vector<Vec3i> refills)
+int main()
 {
-	Vec3i oldPos = turtle.Pos;
+	std::cout << "== vox2bin ==\n";
 
-	Vec3i nearestRefill;
-	unsigned int minDist = std::numeric_limits<unsigned int>().max();
-	for (Vec3i refill : refills)
+	std::string str;
+	std::cout << "Path to model: ";
+	std::cin >> str;
+	std::cout << "Load model into sparse bricks? (Y/N, for mostly empty models) ";
+	std::string sparse;
+	std::cin >> sparse;
+	bool bricked = sparse == "y" || sparse == "Y";
+
+	//mapped models are read from disk (and decoded if compressed) only when the layer is planned, bricked ones are read up front but don't keep empty space in memory
+	std::unique_ptr<VoxelModel> loaded = std::make_unique<VoxelModel>(str, bricked ? VoxelStorage::Bricked : VoxelStorage::Mapped);
+	std::cout << "Model dimensions (X Y Z): " << loaded->Width << " x " << loaded->Length << " x " << loaded->Height << ", material count: " << static_cast<int>(loaded->MaterialCount) << "\n";
+
+	std::cout << "Shell thickness (voxels further from the surface are not built, 0 to build the model solid): ";
+	unsigned int thickness;
+	std::cin >> thickness;
+	if (thickness > 0)
 	{
-		unsigned int dist = (refill - turtle.Pos).LengthLinear();
-		if (dist < minDist)
+		//compressed models are read only, voxels have to be stored in bricks to remove some of them
+		if (loaded->Storage == VoxelStorage::Compressed)
 		{
-			minDist = dist;
-			nearestRefill = refill;
+			std::cout << "Loading compressed model into bricks...\n";
+			loaded = std::make_unique<VoxelModel>(str, VoxelStorage::Bricked);
 		}
-	}
 
-	turtle.MoveToGlobal(nearestRefill, false);
-
-	//load first slot with as much coal as possible, consume as much as needed, return the rest back to the storage
-	turtle.SelectSlot(1);
-	turtle.Request(model.MaterialCount + 1, StackSize); //last material + 1 = coal
-	turtle.Refuel(StackSize);
-	turtle.Unload(StackSize);
+		std::cout << "Hollowing model...\n";
+		std::cout << HollowModel(*loaded, thickness) << " voxels removed.\n";
+	}
 
-	RefillBlockBeginning = turtle.Instructions.size();
-	turtle.WriteByte(TurtleAction::None, InventorySize * 5); //2 bytes per select slot instruction and another 3 per request instruction, for each inventory slot
-	turtle.MoveToGlobal(oldPos, true);
-	turtle.SelectedSlot = 0;
+	VoxelModel& model = *loaded;
 
-	SlotsUsed = 0;
-	memset(ItemCount, 0, sizeof(ItemCount));
-	memset(Materials, 0, sizeof(Materials));
-	memset(CurrentSlot, 0, sizeof(CurrentSlot));
+	std::cout << "Model's position (X Y Z): ";
+	std::cin.ignore();
+	std::getline(std::cin, str);
+	Vec3i start = Vec3i::FromString(str);
 
-	for (int i = 0; i < model.MaterialCount; i++)
+	std::vector<Vec3i> refills;
+	while (true)
 	{
-		ItemCount[i] = 0;
-		Materials[i] = i;
-		CurrentSlot[i] = i;
-		SlotsUsed++;
+		std::cout << "Refill position (X Y Z, empty string to stop inputting refill positions): ";
+		std::getline(std::cin, str);
+		if (str.empty())
+			break;
+		refills.push_back(Vec3i::FromString(str));
 	}
 
-	RefillCount++;
-}
-
-void UseMaterial(Turtle& turtle, VoxelModel& model, std::vector<Vec3i> refills, unsigned char mat)
-{
-	mat = mat - 1; //material 0 is void so first material will have index 0 thus we need to subtract 1
-	unsigned char slot = CurrentSlot[mat];
-	if (++ItemCount[slot] == StackSize)
+	//materials are known before building so the output file can be streamed
+	std::vector<std::string> mats;
+	std::cout << "Material blocks  (e.g. 'minecraft:dirt'):\n";
+	for (int i = 0; i < model.MaterialCount; i++)
 	{
-		CurrentSlot[mat] = SlotsUsed;
-		Materials[SlotsUsed] = mat;
-		SlotsUsed++;
+		std::cout << "Material " << mats.size() + 1 << ": ";
+		std::getline(std::cin, str);
+		if (str.empty())
+			break;
+		mats.push_back(str);
 	}
 
-	if (SlotsUsed == InventorySize + 1) //since "SlotsUsed" counts how many slots are used and not if they're fully filled we need to add one
-	{
-		WriteRefillBlock(turtle);
-		RefillTurtle(turtle, model, refills);
-	};
-}
+	std::cout << "Fuel type (e.g. 'minecraft:coal'): ";
+	std::cin >> str;
+	mats.push_back(str);
 
-void AddRangeToIslands(std::vector<std::vector<Vec3i>>& islands, Vec3i range)
-{
-	bool islandFound = false;
-	for (std::vector<Vec3i>& island : islands)
-	{
-		Vec3i islandLast = island.back();
-		if (range.X > islandLast.Z || range.Z < islandLast.X)
-			continue;
-		island.push_back(range);
-		islandFound = true;
-		break;
-	}
+	unsigned int fuelPerItem;
+	std::cout << "Fuel value of one fuel item (e.g. 80 for coal): ";
+	std::cin >> fuelPerItem;
 
-	if (!islandFound)
-		islands.push_back(std::vector<Vec3i>{ range });
-}
+	unsigned int fuelLimit;
+	std::cout << "Turtle's fuel limit (20000 for turtles, 100000 for advanced turtles): ";
+	std::cin >> fuelLimit;
 
-std::vector<std::vector<Vec3i>> GetIslands(
-	VoxelModel& model,
-	Vec3i offset,
-	unsigned int z)
-{
-	unsigned char* layer = model.GetLayer(z);
-	bool startingEdge;
-	std::vector<std::vector<Vec3i>> islands;
-	Vec3i range; //range X - start X coordinate, Z - end X coordinate, Y - Y coordinate
-	for (int y = 0; y < model.Length; y++)
-	{
-		startingEdge = true;
-		int wy = model.Length - y + offset.Y - 1;
-		range = Vec3i(offset.X, wy, offset.X + model.Width - 1);
+	long long startFuel;
+	std::cout << "Turtle's fuel level at the start: ";
+	std::cin >> startFuel;
+	startFuel = std::min<long long>(startFuel, fuelLimit);
 
-		for (int x = 0; x < model.Width; x++)
-		{
-			int wx = x + offset.X;
-			unsigned char mat = layer[model.Width * y + x];
+	std::cout << "Stream instructions to the output file? (Y/N, for very tall models) ";
+	std::cin >> str;
+	bool stream = str == "y" || str == "Y";
 
-			if (startingEdge && mat)
-			{
-				range.X = wx;
-				startingEdge = false;
-			}
+	std::cout << "Island tour optimization time per layer (ms, 0 for a greedy tour): ";
+	std::cin >> TourBudget;
 
-			if (!startingEdge && !mat)
-			{
-				range.Z = wx - 1;
-				AddRangeToIslands(islands, range);
-				range = Vec3i(offset.X, wy, offset.X + model.Width - 1);
-				startingEdge = true;
-			}
-		}
+	std::cout << "Build two layers per pass where it saves moves? (Y/N) ";
+	std::cin >> str;
+	MultiLayer = str == "y" || str == "Y";
 
-		if (!startingEdge)
-			AddRangeToIslands(islands, range);
+	std::cout << "Schedule refills ahead to shorten trips to refill positions? (Y/N, plans the build twice) ";
+	std::cin >> str;
+	ScheduleRefills = str == "y" || str == "Y";
+
+	//tours are optimized until they stop improving or their time runs out, only the latter depends on how busy the cores are
+	std::cout << "Planning threads per turtle (upcoming layers are prepared on them, 0 for one per core, the output is the same for any count"
+		<< (TourBudget == 0 ? "" : " unless tour optimization runs out of time") << "): ";
+	std::cin >> PlanningThreads;
+	if (PlanningThreads == 0)
+		PlanningThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::cout << "Turtle count (the model is split between them): ";
+	unsigned int turtleCount;
+	std::cin >> turtleCount;
+	turtleCount = std::clamp(turtleCount, 1u, model.Width);
+
+	std::vector<unsigned int> stripes = { 0, model.Width };
+	if (turtleCount > 1)
+	{
+		stripes = GetStripes(model, turtleCount);
+		turtleCount = stripes.size() - 1;
 	}
 
-	return islands;
-}
+	std::vector<Turtle> turtles = std::vector<Turtle>(turtleCount);
+	for (Turtle& turtle : turtles)
+	{
+		turtle.FuelPerItem = fuelPerItem;
+		turtle.FuelLimit = fuelLimit;
+		turtle.FuelLevel = startFuel;
+	}
 
-void BuildIsland(
-	Turtle& turtle,
-	VoxelModel& model,
-	std::vector<Vec3i>& refills,
-	std::vector<Vec3i>& island,
-	Vec3i offset,
-	unsigned int z)
-{
-	unsigned char* layer = model.GetLayer(z);
-	bool left2right = true; //if set turtle will build the range from start to end, vice versa otherwise
-	for (Vec3i range : island)
+	std::vector<BuildState> states = std::vector<BuildState>(turtleCount);
+	std::cin.ignore();
+	for (unsigned int i = 0; i < turtleCount; i++)
 	{
-		turtle.MoveToGlobal(Vec3i(left2right ? range.X : range.Z, range.Y, turtle.Pos.Z));
+		BuildState& state = states[i];
+		state.MinX = stripes[i];
+		state.MaxX = stripes[i + 1];
+		state.Refills = refills;
+		if (turtleCount == 1)
+			continue;
 
-		for (int i = 0; i < range.Z - range.X + 1; i++)
+		int minX = start.X + state.MinX;
+		int maxX = start.X + state.MaxX - 1;
+		std::cout << "Turtle " << i + 1 << " builds columns from X " << minX << " to " << maxX << ", starting position (X Y Z): ";
+		std::getline(std::cin, str);
+		state.Start = Vec3i::FromString(str);
+		turtles[i].Pos = turtles[i].MinPos = turtles[i].MaxPos = state.Start;
+		if (state.Start.X < minX || state.Start.X > maxX)
+			std::cout << "Warning: starting position is outside of the turtle's columns, it may run into other turtles.\n";
+
+		//only refills in front of the turtle's columns can be reached without crossing paths of other turtles
+		std::erase_if(state.Refills, [&](Vec3i refill) { return refill.X < minX || refill.X > maxX; });
+		if (state.Refills.empty())
 		{
-			int y = model.Length - turtle.Pos.Y + offset.Y - 1;
-			unsigned char mat = layer[y * model.Width + turtle.Pos.X - offset.X];
-			turtle.SelectSlot(CurrentSlot[mat - 1] + 1); //slots range from 1 to 16 (inv size) thus we need to add 1
-			turtle.Place(PlaceDigDirection::Below);
-			UseMaterial(turtle, model, refills, mat);
-
-			if (i != range.Z - range.X)
-				turtle.MoveByGlobal(Vec3i(left2right ? 1 : -1, 0, 0));
+			std::cout << "Warning: there is no refill position in front of the turtle's columns, it may run into other turtles on its way to refill.\n";
+			state.Refills = refills;
 		}
-
-		left2right = !left2right;
 	}
-}
 
-void BuildLayer(
-	Turtle& turtle,
-	VoxelModel& model,
-	std::vector<Vec3i>& refills,
-	Vec3i offset,
-	unsigned int z)
-{
-	std::vector<std::vector<Vec3i>> islands = GetIslands(model, offset, z);
-
-	while (!islands.empty())
+	//each turtle is planned on its own thread, errors (e.g. when the turtle can't carry enough fuel) are reported once all of them finish
+	std::cout << "Building model...\n";
+	std::vector<std::string> paths;
+	std::vector<std::string> errors = std::vector<std::string>(turtleCount);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < turtleCount; i++)
 	{
-		int nearestIsland;
-		unsigned int minDist = std::numeric_limits<unsigned int>().max();
-		for (int i = 0; i < islands.size(); i++)
+		paths.push_back(turtleCount == 1 ? "vox2bin-output.bin" : "vox2bin-output-" + std::to_string(i + 1) + ".bin");
+		threads.emplace_back([&, i]()
 		{
-			std::vector<Vec3i>& island = islands[i];
-			Vec3i islandFirst = island.front();
-			unsigned int dist = abs(turtle.Pos.X - islandFirst.X) + abs(turtle.Pos.Y - islandFirst.Y);
-			if (dist < minDist)
+			try
 			{
-				minDist = dist;
-				nearestIsland = i;
-			}
-		}
+				if (stream)
+					turtles[i].BeginStream(paths[i], mats);
 
-		BuildIsland(turtle, model, refills, islands[nearestIsland], offset, z);
-		islands.erase(islands.begin() + nearestIsland);
-	}
-}
+				BuildModel(turtles[i], states[i], model, start);
 
-//'mats' is vector containing material block names for each material index
-//'start' is model's global position
-//'refills' are global positions where turtle can request additional fuel and materials, turtle controller must be running to handle their requests
-//todo: too lazy to optimize this right now (easiest one would be to build some islands starting from bottom/right when applicable)
-void BuildModel(
-	Turtle& turtle,
-	VoxelModel& model,
-	std::vector<Vec3i>& refills,
-	Vec3i offset)
-{
-	RefillTurtle(turtle, model, refills);
-
-	turtle.MoveToGlobal(Vec3i(0, 0, offset.Z));
-	for (int z = 0; z < model.Height; z++)
-	{
-		turtle.MoveByGlobal(Vec3i(0, 0, 1));
-		BuildLayer(turtle, model, refills, offset, z);
+				if (stream)
+					turtles[i].EndStream();
+			}
+			catch (const std::exception& e)
+			{
+				errors[i] = e.what();
+			}
+		});
 	}
 
-	WriteRefillBlock(turtle); //last refill
-	turtle.MoveToGlobal(Vec3i(0), false);
-	turtle.SetRotation(TurtleRotation::North);
-}
+	for (std::thread& thread : threads)
+		thread.join();
 
-int main()
-{
-	std::cout << "== vox2bin ==\n";
-	Turtle turtle = Turtle();
-
-	std::string str;
-	std::cout << "Path to model: ";
-	std::cin >> str;
-	VoxelModel model = VoxelModel(str);
-	std::cout << "Model dimensions (X Y Z): " << model.Width << " x " << model.Length << " x " << model.Height << ", material count: " << static_cast<int>(model.MaterialCount) << "\n";
+	//turtles have to build the whole model, so no output is kept if any of them failed
+	if (std::any_of(errors.begin(), errors.end(), [](const std::string& error) { return !error.empty(); }))
+	{
+		for (unsigned int i = 0; i < turtleCount; i++)
+		{
+			if (!errors[i].empty())
+				std::cout << (turtleCount > 1 ? "Turtle " + std::to_string(i + 1) + ": " : "") << errors[i] << "\n";
+			if (stream)
+			{
+				turtles[i].OutputFile.close();
+				std::filesystem::remove(paths[i]);
+			}
+		}
 
-	std::cout << "Model's position (X Y Z): ";
-	std::cin.ignore();
-	std::getline(std::cin, str);
-	Vec3i start = Vec3i::FromString(str);
+		std::cout << "Build failed, no output was written.\n";
+		return -1;
+	}
 
-	std::vector<Vec3i> refills;
-	while (true)
+	if (!stream)
 	{
-		std::cout << "Refill position (X Y Z, empty string to stop inputting refill positions): ";
-		std::getline(std::cin, str);
-		if (str.empty())
-			break;
-		refills.push_back(Vec3i::FromString(str));
+		for (unsigned int i = 0; i < turtleCount; i++)
+			turtles[i].WriteToFile(paths[i], mats);
 	}
 
-	std::cout << "Building model...\n";
-	BuildModel(turtle, model, refills, start);
-
-	std::vector<std::string> mats;
-	std::cout << "Material blocks  (e.g. 'minecraft:dirt'):\n";
-	for (int i = 0; i < model.MaterialCount; i++)
+	for (unsigned int i = 0; i < turtleCount; i++)
 	{
-		std::cout << "Material " << mats.size() + 1 << ": ";
-		std::getline(std::cin, str);
-		if (str.empty())
-			break;
-		mats.push_back(str);
+		if (turtleCount > 1)
+			std::cout << "Turtle " << i + 1 << ": ";
+		std::cout << turtles[i].GetInstructionCount() << " bytes, " << states[i].RefillCount << " refills.\n";
 	}
 
-	std::cout << "Fuel type (e.g. 'minecraft:coal'): ";
-	std::cin >> str;
-	mats.push_back(str);
-
-	turtle.WriteToFile("vox2bin-output.bin", mats);
-	std::cout << turtle.Instructions.size() << " bytes, " << RefillCount << " refills.\nOutput written to 'vox2bin-output.bin'. Press enter to exit.";
-	std::cin.ignore();
+	std::cout << "Output written to " << (turtleCount == 1 ? "'vox2bin-output.bin'" : "'vox2bin-output-N.bin' (one per turtle)") << ". Press enter to exit.";
 	std::cin.get();
 
 	return 0;
@@ -0,0 +1,672 @@
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include "voxel.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+VoxelModel::VoxelModel(unsigned int width, unsigned int length, unsigned int height, unsigned int matCount, unsigned char* data, VoxelStorage storage)
+{
+	Width = width;
+	Length = length;
+	Height = height;
+	MaterialCount = matCount;
+	Data = data;
+	Storage = storage;
+}
+
+VoxelModel::VoxelModel(unsigned int width, unsigned int length, unsigned int height, unsigned int matCount, VoxelStorage storage)
+{
+	Width = width;
+	Length = length;
+	Height = height;
+	MaterialCount = matCount;
+	Storage = storage;
+
+	switch (storage)
+	{
+	case VoxelStorage::Owned:
+		Data = new unsigned char[GetSize()]();
+		break;
+	case VoxelStorage::Bricked:
+		InitBricks();
+		break;
+	default:
+		throw std::runtime_error("Empty models can only be owned or bricked.");
+	}
+}
+
+VoxelModel::VoxelModel(std::filesystem::path path, VoxelStorage storage)
+{
+	if (storage == VoxelStorage::Mapped)
+	{
+		MapFile(path);
+		return;
+	}
+
+	std::fstream file = std::fstream(path, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to open input file.");
+
+	ReadHeader(file);
+
+	if (storage == VoxelStorage::Bricked)
+	{
+		//reading one brick layer at a time so the dense model is never held in memory
+		Storage = VoxelStorage::Bricked;
+		InitBricks();
+
+		std::vector<unsigned char> slab = std::vector<unsigned char>(GetLayerSize() * BrickSize);
+		for (unsigned int bz = 0; bz < BricksZ; bz++)
+		{
+			unsigned int layers = std::min(BrickSize, Height - bz * BrickSize);
+			try
+			{
+				ReadLayers(file, bz * BrickSize, layers, slab.data());
+			}
+			catch (...)
+			{
+				FreeBricks();
+				throw;
+			}
+
+			WriteSlabToBricks(bz, slab.data(), layers);
+		}
+	}
+	else
+	{
+		Storage = VoxelStorage::Owned;
+		Data = new unsigned char[GetSize()];
+		try
+		{
+			ReadLayers(file, 0, Height, Data);
+		}
+		catch (...)
+		{
+			delete[] Data;
+			throw;
+		}
+	}
+
+	LayerOffsets.clear(); //model isn't compressed anymore
+	file.close();
+}
+
+VoxelModel::~VoxelModel()
+{
+	switch (Storage)
+	{
+	case VoxelStorage::Owned:
+		delete[] Data;
+		break;
+	case VoxelStorage::Mapped:
+	case VoxelStorage::Compressed:
+		UnmapFile();
+		break;
+	case VoxelStorage::Bricked:
+		FreeBricks();
+		break;
+	case VoxelStorage::Borrowed:
+		break;
+	}
+}
+
+bool VoxelModel::IsDense() const
+{
+	return Storage == VoxelStorage::Owned || Storage == VoxelStorage::Borrowed || Storage == VoxelStorage::Mapped;
+}
+
+size_t VoxelModel::GetLayerSize() const
+{
+	return static_cast<size_t>(Width) * Length;
+}
+
+size_t VoxelModel::GetSize() const
+{
+	return GetLayerSize() * Height;
+}
+
+void VoxelModel::WriteToFile(std::filesystem::path path, bool compress)
+{
+	std::fstream file = std::fstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		throw std::runtime_error("Failed to create output file.");
+
+	if (compress)
+	{
+		unsigned int marker = 0;
+		unsigned int version = CompressedVersion;
+		file.write(reinterpret_cast<char*>(&marker), sizeof(unsigned int));
+		file.write(reinterpret_cast<char*>(&version), sizeof(unsigned int));
+	}
+
+	file.write(reinterpret_cast<char*>(&Width), sizeof(unsigned int));
+	file.write(reinterpret_cast<char*>(&Length), sizeof(unsigned int));
+	file.write(reinterpret_cast<char*>(&Height), sizeof(unsigned int));
+	file.write(reinterpret_cast<char*>(&MaterialCount), sizeof(unsigned char));
+
+	if (!compress)
+	{
+		if (IsDense())
+		{
+			file.write(reinterpret_cast<char*>(Data), GetSize());
+		}
+		else
+		{
+			for (unsigned int z = 0; z < Height; z++)
+				file.write(reinterpret_cast<char*>(GetLayer(z)), GetLayerSize());
+		}
+
+		file.close();
+		return;
+	}
+
+	//offset table is filled in after all of the layers are written
+	std::vector<uint64_t> offsets = std::vector<uint64_t>(Height + 1);
+	std::streampos tablePos = file.tellp();
+	file.write(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+	std::vector<unsigned char> runs;
+	for (unsigned int z = 0; z < Height; z++)
+	{
+		offsets[z] = file.tellp();
+		runs.clear();
+		EncodeRuns(GetLayer(z), GetLayerSize(), runs);
+		file.write(reinterpret_cast<char*>(runs.data()), runs.size());
+	}
+	offsets[Height] = file.tellp();
+
+	file.seekp(tablePos);
+	file.write(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+	file.close();
+}
+
+unsigned char* VoxelModel::GetLayer(unsigned int layer)
+{
+	if (IsDense())
+		return Data + layer * GetLayerSize();
+
+	if (BufferedLayer == layer)
+		return LayerBuffer.data();
+
+	LayerBuffer.resize(GetLayerSize());
+	CopyLayer(layer, LayerBuffer.data());
+	BufferedLayer = layer;
+	return LayerBuffer.data();
+}
+
+void VoxelModel::CopyLayer(unsigned int layer, unsigned char* dst) const
+{
+	if (IsDense())
+	{
+		memcpy(dst, Data + layer * GetLayerSize(), GetLayerSize());
+		return;
+	}
+
+	if (Storage == VoxelStorage::Compressed)
+	{
+		const unsigned char* src = static_cast<unsigned char*>(Mapping) + LayerOffsets[layer];
+		DecodeLayer(src, LayerOffsets[layer + 1] - LayerOffsets[layer], dst);
+		return;
+	}
+
+	unsigned int bz = layer / BrickSize;
+	size_t brickLayerOffset = static_cast<size_t>(layer % BrickSize) * BrickSize * BrickSize;
+	for (unsigned int y = 0; y < Length; y++)
+	{
+		unsigned char* row = dst + static_cast<size_t>(y) * Width;
+		size_t brickRowOffset = brickLayerOffset + (y % BrickSize) * BrickSize;
+		for (unsigned int bx = 0; bx < BricksX; bx++)
+		{
+			unsigned int x = bx * BrickSize;
+			unsigned int count = std::min(BrickSize, Width - x);
+			unsigned char* brick = Bricks[(static_cast<size_t>(bz) * BricksY + y / BrickSize) * BricksX + bx];
+			if (brick)
+				memcpy(row + x, brick + brickRowOffset, count);
+			else
+				memset(row + x, 0, count);
+		}
+	}
+}
+
+void VoxelModel::SetLayer(unsigned int layer, const unsigned char* data)
+{
+	if (Storage == VoxelStorage::Compressed)
+		throw std::runtime_error("Compressed models are read only.");
+
+	Modified = true;
+	if (IsDense())
+	{
+		memcpy(GetLayer(layer), data, GetLayerSize());
+		return;
+	}
+
+	for (unsigned int y = 0; y < Length; y++)
+	{
+		for (unsigned int x = 0; x < Width; x++)
+		{
+			Set(x, y, layer, data[static_cast<size_t>(y) * Width + x]);
+		}
+	}
+}
+
+void VoxelModel::ReleaseLayer(unsigned int layer)
+{
+	if (!Mapping || Modified)
+		return;
+
+	//range of the mapping used by the layer
+	size_t begin, end;
+	if (Storage == VoxelStorage::Compressed)
+	{
+		begin = LayerOffsets[layer];
+		end = LayerOffsets[layer + 1];
+	}
+	else
+	{
+		begin = VoxelHeaderSize + layer * GetLayerSize();
+		end = begin + GetLayerSize();
+	}
+
+	//only whole pages can be released, pages shared with neighbouring layers are kept
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	size_t pageSize = info.dwPageSize;
+#else
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+#endif
+	begin = (begin + pageSize - 1) / pageSize * pageSize;
+	end = end / pageSize * pageSize;
+	if (begin >= end)
+		return;
+
+	unsigned char* pages = static_cast<unsigned char*>(Mapping) + begin;
+#ifdef _WIN32
+	VirtualUnlock(pages, end - begin); //removes unlocked pages from the working set
+#else
+	madvise(pages, end - begin, MADV_DONTNEED); //pages were never written so they will be read from the file again if needed
+#endif
+}
+
+VoxelModel VoxelModel::GetSlice(unsigned int start, unsigned int end)
+{
+	if (!IsDense())
+		throw std::runtime_error("Only dense models can be sliced.");
+
+	return VoxelModel(Width, Length, end - start, MaterialCount, GetLayer(start), VoxelStorage::Borrowed);
+}
+
+unsigned char VoxelModel::Get(unsigned int x, unsigned int y, unsigned int z)
+{
+	if (IsDense())
+		return Data[z * GetLayerSize() + static_cast<size_t>(y) * Width + x];
+
+	if (Storage == VoxelStorage::Compressed)
+		return GetLayer(z)[static_cast<size_t>(y) * Width + x];
+
+	unsigned char* brick = Bricks[GetBrickIndex(x, y, z)];
+	if (!brick)
+		return 0;
+	return brick[((z % BrickSize) * BrickSize + y % BrickSize) * BrickSize + x % BrickSize];
+}
+
+void VoxelModel::Set(unsigned int x, unsigned int y, unsigned int z, unsigned char mat)
+{
+	if (Storage == VoxelStorage::Compressed)
+		throw std::runtime_error("Compressed models are read only.");
+
+	Modified = true;
+	if (IsDense())
+	{
+		Data[z * GetLayerSize() + static_cast<size_t>(y) * Width + x] = mat;
+		return;
+	}
+
+	unsigned char*& brick = Bricks[GetBrickIndex(x, y, z)];
+	if (!brick)
+	{
+		if (!mat)
+			return;
+		brick = new unsigned char[BrickSize * BrickSize * BrickSize]();
+	}
+
+	brick[((z % BrickSize) * BrickSize + y % BrickSize) * BrickSize + x % BrickSize] = mat;
+	if (BufferedLayer == z)
+		BufferedLayer = NoLayer;
+}
+
+bool VoxelModel::CanSkipRow(unsigned int y, unsigned int z) const
+{
+	if (Storage != VoxelStorage::Bricked)
+		return false;
+
+	size_t first = GetBrickIndex(0, y, z);
+	for (unsigned int bx = 0; bx < BricksX; bx++)
+	{
+		if (Bricks[first + bx])
+			return false;
+	}
+
+	return true;
+}
+
+bool VoxelModel::CanSkipLayer(unsigned int z) const
+{
+	if (Storage != VoxelStorage::Bricked)
+		return false;
+
+	size_t first = GetBrickIndex(0, 0, z);
+	for (size_t i = 0; i < static_cast<size_t>(BricksX) * BricksY; i++)
+	{
+		if (Bricks[first + i])
+			return false;
+	}
+
+	return true;
+}
+
+size_t VoxelModel::ReadHeader(std::istream& file)
+{
+	unsigned char header[VoxelHeaderSize];
+	file.read(reinterpret_cast<char*>(header), sizeof(unsigned int));
+
+	unsigned int marker;
+	memcpy(&marker, header, sizeof(unsigned int));
+	if (marker != 0)
+	{
+		file.read(reinterpret_cast<char*>(header + 4), VoxelHeaderSize - 4);
+		ReadHeader(header);
+		if (!file)
+			throw std::runtime_error("Input file is truncated.");
+		return VoxelHeaderSize;
+	}
+
+	unsigned int version;
+	file.read(reinterpret_cast<char*>(&version), sizeof(unsigned int));
+	if (version != CompressedVersion)
+		throw std::runtime_error("Unsupported model version.");
+
+	file.read(reinterpret_cast<char*>(header), VoxelHeaderSize);
+	ReadHeader(header);
+
+	LayerOffsets.resize(static_cast<size_t>(Height) + 1);
+	file.read(reinterpret_cast<char*>(LayerOffsets.data()), LayerOffsets.size() * sizeof(uint64_t));
+	if (!file)
+		throw std::runtime_error("Input file is truncated.");
+
+	std::streampos tableEnd = file.tellg();
+	file.seekg(0, std::ios::end);
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	file.seekg(tableEnd);
+	CheckLayerOffsets(fileSize);
+
+	return CompressedHeaderSize + LayerOffsets.size() * sizeof(uint64_t);
+}
+
+void VoxelModel::ReadHeader(const unsigned char* header)
+{
+	memcpy(&Width, header, sizeof(unsigned int));
+	memcpy(&Length, header + 4, sizeof(unsigned int));
+	memcpy(&Height, header + 8, sizeof(unsigned int));
+	MaterialCount = header[12];
+}
+
+void VoxelModel::CheckLayerOffsets(size_t fileSize) const
+{
+	//layer sizes are differences of neighbouring offsets, so they have to be non-decreasing and start after the table
+	uint64_t tableEnd = CompressedHeaderSize + LayerOffsets.size() * sizeof(uint64_t);
+	if (LayerOffsets.front() < tableEnd || !std::is_sorted(LayerOffsets.begin(), LayerOffsets.end()))
+		throw std::runtime_error("Corrupted layer offsets.");
+	if (LayerOffsets.back() > fileSize)
+		throw std::runtime_error("Input file is truncated.");
+}
+
+//whole file is mapped and 'Data' is pointed right after the header, nothing is read until the planner touches a layer
+//compressed files keep only the offset table, their layers are decoded from the mapping by 'GetLayer'
+void VoxelModel::MapFile(std::filesystem::path path)
+{
+	size_t fileSize = std::filesystem::exists(path) ? std::filesystem::file_size(path) : 0;
+	if (fileSize < VoxelHeaderSize)
+		throw std::runtime_error("Failed to open input file.");
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Failed to open input file.");
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping)
+		throw std::runtime_error("Failed to map input file.");
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping); //view keeps the mapping alive
+	if (!view)
+		throw std::runtime_error("Failed to map input file.");
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		throw std::runtime_error("Failed to open input file.");
+
+	void* view = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file); //mapping keeps the file alive
+	if (view == MAP_FAILED)
+		throw std::runtime_error("Failed to map input file.");
+#endif
+
+	Mapping = view;
+	MappingSize = fileSize;
+	Storage = VoxelStorage::Mapped;
+
+	unsigned char* bytes = static_cast<unsigned char*>(Mapping);
+	unsigned int marker;
+	memcpy(&marker, bytes, sizeof(unsigned int));
+
+	if (marker != 0)
+	{
+		ReadHeader(bytes);
+		Data = bytes + VoxelHeaderSize;
+
+		if (fileSize - VoxelHeaderSize < GetSize())
+		{
+			UnmapFile();
+			throw std::runtime_error("Input file is truncated.");
+		}
+
+		return;
+	}
+
+	unsigned int version;
+	memcpy(&version, bytes + 4, sizeof(unsigned int));
+	if (fileSize < CompressedHeaderSize || version != CompressedVersion)
+	{
+		UnmapFile();
+		throw std::runtime_error("Unsupported model version.");
+	}
+
+	Storage = VoxelStorage::Compressed;
+	ReadHeader(bytes + 8);
+
+	LayerOffsets.resize(static_cast<size_t>(Height) + 1);
+	size_t tableSize = LayerOffsets.size() * sizeof(uint64_t);
+	if (fileSize - CompressedHeaderSize < tableSize)
+	{
+		UnmapFile();
+		throw std::runtime_error("Input file is truncated.");
+	}
+
+	memcpy(LayerOffsets.data(), bytes + CompressedHeaderSize, tableSize);
+	try
+	{
+		CheckLayerOffsets(fileSize);
+	}
+	catch (...)
+	{
+		UnmapFile();
+		throw;
+	}
+}
+
+void VoxelModel::UnmapFile()
+{
+	if (!Mapping)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(Mapping);
+#else
+	munmap(Mapping, MappingSize);
+#endif
+
+	Mapping = nullptr;
+	MappingSize = 0;
+	Data = nullptr;
+}
+
+size_t VoxelModel::GetBrickIndex(unsigned int x, unsigned int y, unsigned int z) const
+{
+	return (static_cast<size_t>(z / BrickSize) * BricksY + y / BrickSize) * BricksX + x / BrickSize;
+}
+
+void VoxelModel::InitBricks()
+{
+	BricksX = (Width + BrickSize - 1) / BrickSize;
+	BricksY = (Length + BrickSize - 1) / BrickSize;
+	BricksZ = (Height + BrickSize - 1) / BrickSize;
+	Bricks = std::vector<unsigned char*>(static_cast<size_t>(BricksX) * BricksY * BricksZ, nullptr);
+}
+
+void VoxelModel::FreeBricks()
+{
+	for (unsigned char* brick : Bricks)
+		delete[] brick;
+	Bricks.clear();
+}
+
+void VoxelModel::DecodeLayer(const unsigned char* src, size_t srcSize, unsigned char* dst) const
+{
+	size_t size = GetLayerSize();
+	size_t i = 0;
+	size_t o = 0;
+	while (i < srcSize)
+	{
+		unsigned char control = src[i++];
+		if (control < 128)
+		{
+			size_t count = control + 1;
+			if (i + count > srcSize || o + count > size)
+				throw std::runtime_error("Corrupted layer data.");
+			memcpy(dst + o, src + i, count);
+			i += count;
+			o += count;
+		}
+		else
+		{
+			size_t count = control - 126;
+			if (i >= srcSize || o + count > size)
+				throw std::runtime_error("Corrupted layer data.");
+			memset(dst + o, src[i++], count);
+			o += count;
+		}
+	}
+
+	if (o != size)
+		throw std::runtime_error("Corrupted layer data.");
+}
+
+void VoxelModel::ReadLayers(std::istream& file, unsigned int first, unsigned int count, unsigned char* dst)
+{
+	if (LayerOffsets.empty())
+	{
+		size_t size = GetLayerSize() * count;
+		file.read(reinterpret_cast<char*>(dst), size);
+		if (static_cast<size_t>(file.gcount()) != size)
+			throw std::runtime_error("Input file is truncated.");
+		return;
+	}
+
+	std::vector<unsigned char> runs;
+	file.seekg(LayerOffsets[first]);
+	for (unsigned int z = first; z < first + count; z++)
+	{
+		size_t size = LayerOffsets[z + 1] - LayerOffsets[z];
+		runs.resize(size);
+		file.read(reinterpret_cast<char*>(runs.data()), size);
+		if (static_cast<size_t>(file.gcount()) != size)
+			throw std::runtime_error("Input file is truncated.");
+		DecodeLayer(runs.data(), size, dst + (z - first) * GetLayerSize());
+	}
+}
+
+void VoxelModel::WriteSlabToBricks(unsigned int bz, const unsigned char* slab, unsigned int layers)
+{
+	for (unsigned int by = 0; by < BricksY; by++)
+	{
+		unsigned int rows = std::min(BrickSize, Length - by * BrickSize);
+		for (unsigned int bx = 0; bx < BricksX; bx++)
+		{
+			unsigned int columns = std::min(BrickSize, Width - bx * BrickSize);
+			unsigned char*& brick = Bricks[(static_cast<size_t>(bz) * BricksY + by) * BricksX + bx];
+
+			for (unsigned int z = 0; z < layers; z++)
+			{
+				for (unsigned int y = 0; y < rows; y++)
+				{
+					const unsigned char* row = slab + z * GetLayerSize() + static_cast<size_t>(by * BrickSize + y) * Width + bx * BrickSize;
+					if (!brick && std::all_of(row, row + columns, [](unsigned char mat) { return mat == 0; }))
+						continue;
+
+					if (!brick)
+						brick = new unsigned char[BrickSize * BrickSize * BrickSize]();
+					memcpy(brick + (z * BrickSize + y) * BrickSize, row, columns);
+				}
+			}
+		}
+	}
+}
+
+void EncodeRuns(const unsigned char* src, size_t size, std::vector<unsigned char>& dst)
+{
+	size_t i = 0;
+	while (i < size)
+	{
+		//repeated bytes, runs shorter than 3 are cheaper to keep in literal blocks
+		size_t run = 1;
+		while (i + run < size && run < 129 && src[i + run] == src[i])
+			run++;
+
+		if (run >= 3)
+		{
+			dst.push_back(static_cast<unsigned char>(run + 126));
+			dst.push_back(src[i]);
+			i += run;
+			continue;
+		}
+
+		//literal block, ends where the next run of 3 begins
+		size_t start = i;
+		while (i < size && i - start < 128)
+		{
+			if (i + 2 < size && src[i] == src[i + 1] && src[i] == src[i + 2])
+				break;
+			i++;
+		}
+
+		dst.push_back(static_cast<unsigned char>(i - start - 1));
+		dst.insert(dst.end(), src + start, src + i);
+	}
+}
@@ -1,8 +1,29 @@
 #pragma once
-#include <fstream>
+#include <cstddef>
 #include <filesystem>
+#include <iosfwd>
+#include <vector>
+#include <cstdint>
 
 const unsigned char RemoveMaterial = 255;
+const unsigned int VoxelHeaderSize = 13; //width, length, height (4 bytes each) and material count (1 byte)
+const unsigned int CompressedVersion = 2; //v2 files start with a zero (v1 width can't be zero) followed by the version, then the v1 header and the layer offset table
+const unsigned int CompressedHeaderSize = 8 + VoxelHeaderSize;
+const unsigned int BrickSize = 16; //bricked models are split into cubes with this side length
+const unsigned int NoLayer = 0xFFFFFFFF;
+
+enum class VoxelStorage : unsigned char
+{
+	Owned, //'Data' is allocated with new[] and freed with the model
+	Borrowed, //'Data' belongs to another model (e.g. slices)
+	Mapped, //'Data' points straight into a memory mapped file, pages are read from disk when they are first accessed
+	Bricked, //'Data' is unused, voxels are stored in 'Bricks' and empty bricks are not allocated
+	Compressed //'Data' is unused, compressed file is memory mapped and layers are decoded one at a time when requested
+};
+
+//packbits style run length encoding, each run starts with a control byte C:
+//C < 128 - C + 1 bytes are copied as is, C >= 128 - following byte is repeated C - 126 times
+void EncodeRuns(const unsigned char* src, size_t size, std::vector<unsigned char>& dst);
 
 struct VoxelModel
 {
@@ -10,62 +31,75 @@ struct VoxelModel
 	unsigned int Length;
 	unsigned int Height;
 	unsigned char MaterialCount;
-	unsigned char* Data;
-
-	VoxelModel(unsigned int width, unsigned int length, unsigned int height, unsigned int matCount, unsigned char* data)
-	{
-		Width = width;
-		Length = length;
-		Height = height;
-		MaterialCount = matCount;
-		Data = data;
-	};
-
-	VoxelModel(std::filesystem::path path)
-	{
-		std::fstream file = std::fstream(path, std::ios::in | std::ios::binary);
-		if (!file.is_open())
-			throw std::runtime_error("Failed to open input file.");
-
-		file.read(reinterpret_cast<char*>(&Width), sizeof(unsigned int));
-		file.read(reinterpret_cast<char*>(&Length), sizeof(unsigned int));
-		file.read(reinterpret_cast<char*>(&Height), sizeof(unsigned int));
-		file.read(reinterpret_cast<char*>(&MaterialCount), sizeof(unsigned char));
-
-		unsigned int size = Width * Length * Height;
-		Data = new unsigned char[size];
-		file.read(reinterpret_cast<char*>(Data), size);
-
-		file.close();
-	}
-
-	~VoxelModel()
-	{
-		delete[] Data;
-	}
-
-	void WriteToFile(std::filesystem::path path)
-	{
-		std::fstream file = std::fstream(path, std::ios::out | std::ios::binary | std::ios::trunc);
-		if (!file.is_open())
-			throw std::runtime_error("Failed to create output file.");
-
-		file.write(reinterpret_cast<char*>(&Width), sizeof(unsigned int));
-		file.write(reinterpret_cast<char*>(&Length), sizeof(unsigned int));
-		file.write(reinterpret_cast<char*>(&Height), sizeof(unsigned int));
-		file.write(reinterpret_cast<char*>(&MaterialCount), sizeof(unsigned char));
-		file.write(reinterpret_cast<char*>(Data), Width * Length * Height);
-
-		file.close();
-	}
-
-	unsigned char* GetLayer(unsigned int layer)
-	{
-		return Data + layer * Width * Length;
-	}
-
-	VoxelModel GetSlice(unsigned int start, unsigned int end)
-	{
-		return VoxelModel(Width, Length, end - start, MaterialCount, GetLayer(start));
-	}
+	unsigned char* Data = nullptr;
+	VoxelStorage Storage = VoxelStorage::Owned;
+
+	//file mapping, valid only for mapped models
+	void* Mapping = nullptr;
+	size_t MappingSize = 0;
+	bool Modified = false; //set once voxels are changed, changed pages of a mapped file can't be released (they'd be read from the file again)
+
+	//brick table (X fastest, then Y, then Z), valid only for bricked models, null bricks are empty
+	//voxels inside of a brick are ordered the same way as in the model (X fastest, Y starting from the top row)
+	std::vector<unsigned char*> Bricks;
+	unsigned int BricksX = 0;
+	unsigned int BricksY = 0;
+	unsigned int BricksZ = 0;
+
+	//offsets of the run length encoded layers from the beginning of the mapping (one more than the layer count, last one is the end of data), valid only for compressed models
+	std::vector<uint64_t> LayerOffsets;
+
+	//dense copy of the last layer returned by 'GetLayer' for models which don't store layers contiguously
+	std::vector<unsigned char> LayerBuffer;
+	unsigned int BufferedLayer = NoLayer;
+
+	VoxelModel(unsigned int width, unsigned int length, unsigned int height, unsigned int matCount, unsigned char* data, VoxelStorage storage = VoxelStorage::Owned);
+
+	//creates an empty model, 'storage' must be either owned or bricked
+	VoxelModel(unsigned int width, unsigned int length, unsigned int height, unsigned int matCount, VoxelStorage storage);
+
+	//'storage' selects how the file is loaded:
+	//owned - whole file is read into memory
+	//mapped - file is memory mapped (copy on write, so the file itself is never modified), compressed files become compressed models
+	//bricked - file is read a few layers at a time and only non-empty bricks are kept
+	VoxelModel(std::filesystem::path path, VoxelStorage storage = VoxelStorage::Owned);
+
+	VoxelModel(const VoxelModel&) = delete;
+	VoxelModel& operator=(const VoxelModel&) = delete;
+	~VoxelModel();
+
+	bool IsDense() const; //true if 'Data' holds the whole model
+	size_t GetLayerSize() const;
+	size_t GetSize() const;
+
+	//if 'compress' is set the model is written in v2 format with run length encoded layers
+	void WriteToFile(std::filesystem::path path, bool compress = false);
+
+	//for bricked and compressed models returned layer is a copy which stays valid until the next call, writes to it won't reach the model (use 'SetLayer')
+	unsigned char* GetLayer(unsigned int layer);
+	void CopyLayer(unsigned int layer, unsigned char* dst) const; //copies a dense layer to 'dst' without touching the layer buffer, safe to call from multiple threads
+	void SetLayer(unsigned int layer, const unsigned char* data);
+	void ReleaseLayer(unsigned int layer); //hints that the layer won't be needed soon, mapped pages are dropped from memory
+	VoxelModel GetSlice(unsigned int start, unsigned int end);
+
+	unsigned char Get(unsigned int x, unsigned int y, unsigned int z);
+	void Set(unsigned int x, unsigned int y, unsigned int z, unsigned char mat);
+
+	//returns true if the row/layer is known to be empty without scanning it (only bricked models can tell that)
+	bool CanSkipRow(unsigned int y, unsigned int z) const;
+	bool CanSkipLayer(unsigned int z) const;
+
+	//reads v1 header or v2 header with the layer offset table, returns the offset at which voxel data starts
+	size_t ReadHeader(std::istream& file);
+	void ReadHeader(const unsigned char* header);
+	void CheckLayerOffsets(size_t fileSize) const; //throws unless the offset table describes layers inside of the file
+	void MapFile(std::filesystem::path path);
+	void UnmapFile();
+
+	size_t GetBrickIndex(unsigned int x, unsigned int y, unsigned int z) const; //voxel coordinates
+	void InitBricks();
+	void FreeBricks();
+	void DecodeLayer(const unsigned char* src, size_t srcSize, unsigned char* dst) const;
+	void ReadLayers(std::istream& file, unsigned int first, unsigned int count, unsigned char* dst); //reads dense layers from a file positioned at layer 'first' (compressed layers are read from their offsets)
+	void WriteSlabToBricks(unsigned int bz, const unsigned char* slab, unsigned int layers); //'slab' contains 'layers' dense layers starting from layer bz * BrickSize
 };